@@ -12,6 +12,8 @@ BedrockCommand::BedrockCommand(SQLiteCommand&& baseCommand, BedrockPlugin* plugi
     peekCount(0),
     processCount(0),
     repeek(false),
+    singleFlightReleased(false),
+    conflictDeferred(false),
     crashIdentifyingValues(*this),
     escalateImmediately(escalateImmediately_),
     _plugin(plugin),
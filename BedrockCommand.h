@@ -104,6 +104,14 @@ class BedrockCommand : public SQLiteCommand {
     // all HTTPS requests are complete. It will be automatically cleared if the command throws an exception.
     bool repeek;
 
+    // Set on a command that waited for an identical command's `peek` to answer it as well (see `-singleFlightReads`),
+    // when that peek didn't complete. It then runs on its own, rather than waiting on another identical command.
+    bool singleFlightReleased;
+
+    // Set on a command that was put back in the queue to let a command using the same tables finish first (see
+    // `-conflictAwareScheduling`). It isn't put back again.
+    bool conflictDeferred;
+
     // A list of timing sets, with an info type, start, and end.
     list<tuple<TIMING_INFO, uint64_t, uint64_t>> timingInfo;
 
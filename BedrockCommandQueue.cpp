@@ -8,65 +8,137 @@ void BedrockCommandQueue::stopTiming(unique_ptr<BedrockCommand>& command) {
     command->stopTiming(BedrockCommand::QUEUE_WORKER);
 }
 
-BedrockCommandQueue::BedrockCommandQueue() :
-  SScheduledPriorityQueue<unique_ptr<BedrockCommand>>(function<void(unique_ptr<BedrockCommand>&)>(startTiming), function<void(unique_ptr<BedrockCommand>&)>(stopTiming))
-{ }
+BedrockCommandQueue::BedrockCommandQueue(size_t shards) :
+  SShardedPriorityQueue<unique_ptr<BedrockCommand>>(shards,
+                                                    function<void(unique_ptr<BedrockCommand>&)>(startTiming),
+                                                    [this](unique_ptr<BedrockCommand>& command) {
+                                                        stopTiming(command);
+                                                        _recordSojourn(command);
+                                                    }),
+  _intervalStart(STimeNow()), _intervalMinimum(UINT64_MAX), _standingDelay(0), _fair(false)
+{
+    for (size_t i = 0; i < shardCount(); i++) {
+        _flowStats.emplace_back(make_unique<FlowStatsShard>());
+    }
+}
 
-list<string> BedrockCommandQueue::getRequestMethodLines() {
-    list<string> returnVal;
-    SAUTOLOCK(_queueMutex);
-    for (auto& queue : _queue) {
-        for (auto& entry : queue.second) {
-            returnVal.push_back(entry.second.item->request.methodLine);
-        }
+void BedrockCommandQueue::configureFlows(const string& flowHeader, bool fair, const map<string, size_t>& weights) {
+    _flowHeader = flowHeader;
+    _fair = fair;
+    setFlowWeights(weights);
+}
+
+string BedrockCommandQueue::flowOf(const BedrockCommand& command) const {
+    if (!_flowHeader.empty() && command.request.isSet(_flowHeader)) {
+        return command.request[_flowHeader];
     }
-    return returnVal;
+    return command.request.getVerb();
 }
 
-void BedrockCommandQueue::abandonFutureCommands(int msInFuture) {
-    // We're going to delete every command scehduled after this timestamp.
-    uint64_t timeLimit = STimeNow() + msInFuture * 1000;
+void BedrockCommandQueue::_rollInterval(uint64_t now) {
+    uint64_t start = _intervalStart.load();
+    if (now - min(now, start) < SOJOURN_INTERVAL_US || !_intervalStart.compare_exchange_strong(start, now)) {
+        return;
+    }
 
-    // Lock around changes to the queue.
-    unique_lock<mutex> queueLock(_queueMutex);
-
-    // We're going to look at each queue by priority. It's possible we'll end up removing *everything* from multiple
-    // queues. In that case, we need to remove the queues themselves, so we keep a list of queues to delete when we're
-    // done operating on each of them (so that we don't delete them while iterating over them).
-    list<typename decltype(_queue)::iterator> toDelete;
-    for (typename decltype(_queue)::iterator queueMapIt = _queue.begin(); queueMapIt != _queue.end(); ++queueMapIt) {
-        // Starting from the first item, skip any items that have a valid scheduled time.
-        auto commandMapIt = queueMapIt->second.begin();
-        while (commandMapIt != queueMapIt->second.end() && commandMapIt->first < timeLimit) {
-            commandMapIt++;
-        }
+    // If nothing was dequeued in the interval, either there's nothing queued, or nothing's being dequeued at all, in
+    // which case the last delay we saw is the best guess we have.
+    const uint64_t minimum = _intervalMinimum.exchange(UINT64_MAX);
+    if (minimum != UINT64_MAX) {
+        _standingDelay.store(minimum);
+    } else if (empty()) {
+        _standingDelay.store(0);
+    }
+}
 
-        // Whatever's left in the queue is scheduled in the future and can be erased.
-        size_t numberToErase = distance(commandMapIt, queueMapIt->second.end());
-        if (numberToErase) {
-            queueMapIt->second.erase(commandMapIt, queueMapIt->second.end());
-        }
+void BedrockCommandQueue::_recordSojourn(unique_ptr<BedrockCommand>& command) {
+    // Commands scheduled for later are supposed to wait, so they don't tell us anything about our backlog.
+    if (command->request.isSet("commandExecuteTime") || command->timingInfo.empty()) {
+        return;
+    }
+    const auto& timing = command->timingInfo.back();
+    const uint64_t wait = std::get<2>(timing) - std::get<1>(timing);
+    _rollInterval(STimeNow());
+    uint64_t minimum = _intervalMinimum.load();
+    while (wait < minimum && !_intervalMinimum.compare_exchange_weak(minimum, wait)) {
+    }
 
-        // If the whole queue is empty, save it for deletion.
-        if (queueMapIt->second.empty()) {
-            toDelete.push_back(queueMapIt);
-        }
+    thread_local size_t shard = hash<thread::id>()(this_thread::get_id());
+    FlowStatsShard& flowStats = *_flowStats[shard % _flowStats.size()];
+    const string flow = flowOf(*command);
+    lock_guard<mutex> lock(flowStats.flowMutex);
+    if (flowStats.flows.size() >= MAX_FLOW_STATS && !flowStats.flows.count(flow)) {
+        SINFO("Dequeued commands from more than " << MAX_FLOW_STATS << " flows, resetting flow statistics.");
+        flowStats.flows.clear();
+    }
+    FlowStats& stats = flowStats.flows[flow];
+    stats.dequeued++;
+    stats.totalWaitUS += wait;
+    stats.maxWaitUS = max(stats.maxWaitUS, wait);
+}
 
-        // If we deleted any commands, log that.
-        if (numberToErase) {
-            SINFO("Erased " << numberToErase << " commands scheduled more than " << msInFuture << "ms in the future.");
+list<string> BedrockCommandQueue::getFlowStats() {
+    map<string, size_t> queued;
+    forEach([this, &queued](const unique_ptr<BedrockCommand>& command) {
+        queued[flowOf(*command)]++;
+    });
+    map<string, FlowStats> dequeued;
+    for (auto& flowStats : _flowStats) {
+        lock_guard<mutex> lock(flowStats->flowMutex);
+        for (const auto& [flow, stats] : flowStats->flows) {
+            FlowStats& total = dequeued[flow];
+            total.dequeued += stats.dequeued;
+            total.totalWaitUS += stats.totalWaitUS;
+            total.maxWaitUS = max(total.maxWaitUS, stats.maxWaitUS);
         }
     }
+    for (const auto& flow : queued) {
+        dequeued[flow.first];
+    }
 
-    // Delete any empty queues.
-    for (auto& it : toDelete) {
-        _queue.erase(it);
+    list<string> flows;
+    for (const auto& flow : dequeued) {
+        STable stats;
+        stats["flow"] = flow.first;
+        stats["queued"] = to_string(queued.count(flow.first) ? queued[flow.first] : 0);
+        stats["dequeued"] = to_string(flow.second.dequeued);
+        stats["averageWaitUS"] = to_string(flow.second.dequeued ? flow.second.totalWaitUS / flow.second.dequeued : 0);
+        stats["maxWaitUS"] = to_string(flow.second.maxWaitUS);
+        flows.push_back(SComposeJSONObject(stats));
+    }
+    return flows;
+}
+
+uint64_t BedrockCommandQueue::standingDelay() {
+    _rollInterval(STimeNow());
+    return _standingDelay.load();
+}
+
+list<string> BedrockCommandQueue::getRequestMethodLines() {
+    list<string> returnVal;
+    forEach([&returnVal](const unique_ptr<BedrockCommand>& command) {
+        returnVal.push_back(command->request.methodLine);
+    });
+    return returnVal;
+}
+
+void BedrockCommandQueue::abandonFutureCommands(int msInFuture) {
+    // We're going to delete every command scehduled after this timestamp.
+    uint64_t timeLimit = STimeNow() + msInFuture * 1000;
+    size_t numberErased = eraseScheduledAfter(timeLimit);
+    if (numberErased) {
+        SINFO("Erased " << numberErased << " commands scheduled more than " << msInFuture << "ms in the future.");
     }
 }
 
 void BedrockCommandQueue::push(unique_ptr<BedrockCommand>&& command) {
-    BedrockCommand::Priority priority = command->priority;
     uint64_t executionTime = command->request.calcU64("commandExecuteTime");
+    push(move(command), executionTime);
+}
+
+void BedrockCommandQueue::push(unique_ptr<BedrockCommand>&& command, uint64_t executionTime) {
+    BedrockCommand::Priority priority = command->priority;
     uint64_t timeout = command->timeout();
-    SScheduledPriorityQueue<unique_ptr<BedrockCommand>>::push(move(command), priority, executionTime, timeout);
+    string flow = _fair ? flowOf(*command) : "";
+    SShardedPriorityQueue<unique_ptr<BedrockCommand>>::push(move(command), priority, executionTime, timeout, flow);
 }
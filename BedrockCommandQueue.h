@@ -1,11 +1,13 @@
 #pragma once
 #include <libstuff/libstuff.h>
-#include <libstuff/SScheduledPriorityQueue.h>
+#include <libstuff/SShardedPriorityQueue.h>
 #include "BedrockCommand.h"
 
-class BedrockCommandQueue : public SScheduledPriorityQueue<unique_ptr<BedrockCommand>> {
+class BedrockCommandQueue : public SShardedPriorityQueue<unique_ptr<BedrockCommand>> {
   public:
-    BedrockCommandQueue();
+    // The queue is split into `shards` shards, which should be the number of threads dequeuing from it. 0 uses one per
+    // hardware thread, which is also the default number of workers.
+    BedrockCommandQueue(size_t shards = 0);
 
     // Functions to start and stop timing on the commands when they're inserted/removed from the queue.
     static void startTiming(unique_ptr<BedrockCommand>& command);
@@ -20,4 +22,64 @@ class BedrockCommandQueue : public SScheduledPriorityQueue<unique_ptr<BedrockCom
 
     // Add an item to the queue. The queue takes ownership of the item and the caller's copy is invalidated.
     void push(unique_ptr<BedrockCommand>&& command);
+
+    // The same, but the command won't be dequeued before `executionTime` rather than its `commandExecuteTime`.
+    void push(unique_ptr<BedrockCommand>&& command, uint64_t executionTime);
+
+    // Commands are grouped into flows, keyed by the value of the request header `flowHeader`, or by their command name
+    // if that's empty or the request doesn't set it. If `fair` is set, flows at the same priority take turns, with
+    // as many commands per turn as their entry in `weights` (see SShardedPriorityQueue.h). Either way, we keep
+    // per-flow statistics for `Status`. This must be called before the queue is in use.
+    void configureFlows(const string& flowHeader, bool fair, const map<string, size_t>& weights);
+
+    // Returns the flow `command` belongs to.
+    string flowOf(const BedrockCommand& command) const;
+
+    // Returns a JSON object for each flow with commands queued or dequeued, with how many are queued, and how many
+    // have been dequeued and how long they waited.
+    list<string> getFlowStats();
+
+    // If commands from more flows than this have been dequeued by one thread, we forget its statistics for all of them
+    // and start again, so a stream of distinct client IDs can't grow them forever.
+    static const size_t MAX_FLOW_STATS = 1000;
+
+    // We track how long commands wait in the queue before they're dequeued, in the style of CoDel. A queue that's
+    // absorbing a burst still lets some commands through quickly, but a queue with a standing backlog delays all of
+    // them. So rather than an average, we keep the *shortest* wait in each interval, which only rises when every
+    // command in the interval was delayed.
+    static const uint64_t SOJOURN_INTERVAL_US = 100'000;
+
+    // Returns the shortest time, in microseconds, that any command waited in the queue during the most recent complete
+    // interval, or 0 if the queue has since emptied.
+    uint64_t standingDelay();
+
+  private:
+    // Records how long a command that's just been dequeued was waiting.
+    void _recordSojourn(unique_ptr<BedrockCommand>& command);
+
+    // Starts a new interval if the current one is over.
+    void _rollInterval(uint64_t now);
+
+    // Commands are dequeued by many threads at once, so the interval is kept in atomics rather than behind a lock.
+    // The thread that moves `_intervalStart` on is the one that publishes the finished interval's minimum.
+    atomic<uint64_t> _intervalStart;
+    atomic<uint64_t> _intervalMinimum;
+    atomic<uint64_t> _standingDelay;
+
+    struct FlowStats {
+        uint64_t dequeued = 0;
+        uint64_t totalWaitUS = 0;
+        uint64_t maxWaitUS = 0;
+    };
+
+    // Flow statistics are split into one part per queue shard, each with its own lock, and each dequeuing thread
+    // updates the same part every time, so threads don't contend on them. `getFlowStats` adds them up.
+    struct alignas(64) FlowStatsShard {
+        mutex flowMutex;
+        map<string, FlowStats> flows;
+    };
+    vector<unique_ptr<FlowStatsShard>> _flowStats;
+
+    string _flowHeader;
+    bool _fair;
 };
@@ -177,13 +177,22 @@ void BedrockServer::sync(const SData& args,
         workerThreads = 2;
     }
 
+    // If the pool can grow, we start enough threads (and size the DB for enough handles) for the largest it can be,
+    // and park the ones we don't need yet.
+    server._maxWorkerThreads = max(workerThreads, args.calc("-maxWorkerThreads"));
+    server._minWorkerThreads = workerThreads;
+    if (args.isSet("-minWorkerThreads")) {
+        server._minWorkerThreads = min(max(2, args.calc("-minWorkerThreads")), workerThreads);
+    }
+    server._activeWorkerThreads.store(workerThreads);
+
     // Initialize the DB.
     int64_t mmapSizeGB = args.isSet("-mmapSizeGB") ? stoll(args["-mmapSizeGB"]) : 0;
 
     // We use fewer FDs on test machines that have other resource restrictions in place.
     int fdLimit = args.isSet("-live") ? 25'000 : 250;
     SINFO("Setting dbPool size to: " << fdLimit);
-    SQLitePool dbPool(fdLimit, args["-db"], args.calc("-cacheSize"), args.calc("-maxJournalSize"), workerThreads, args["-synchronous"], mmapSizeGB, args.test("-pageLogging"));
+    SQLitePool dbPool(fdLimit, args["-db"], args.calc("-cacheSize"), args.calc("-maxJournalSize"), server._maxWorkerThreads, args["-synchronous"], mmapSizeGB, args.test("-pageLogging"));
     SQLite& db = dbPool.getBase();
 
     // Initialize the command processor.
@@ -205,9 +214,9 @@ void BedrockServer::sync(const SData& args,
     // The node is now coming up, and should eventually end up in a `LEADING` or `FOLLOWING` state. We can start adding
     // our worker threads now. We don't wait until the node is `LEADING` or `FOLLOWING`, as it's state can change while
     // it's running, and our workers will have to maintain awareness of that state anyway.
-    SINFO("Starting " << workerThreads << " worker threads.");
+    SINFO("Starting " << server._maxWorkerThreads << " worker threads, " << workerThreads << " active.");
     list<thread> workerThreadList;
-    for (int threadId = 0; threadId < workerThreads; threadId++) {
+    for (int threadId = 0; threadId < server._maxWorkerThreads; threadId++) {
         workerThreadList.emplace_back(worker,
                                       ref(dbPool),
                                       ref(replicationState),
@@ -227,6 +236,7 @@ void BedrockServer::sync(const SData& args,
     AutoTimer pollTimer("sync thread poll");
     AutoTimer postPollTimer("sync thread PostPoll");
     AutoTimer escalateLoopTimer("sync thread escalate loop");
+    WorkerPoolSample workerPoolSample = {0, 0, 0, 0};
 
     do {
         // Make sure the existing command prefix is still valid since they're reset when SAUTOPREFIX goes out of scope.
@@ -234,6 +244,8 @@ void BedrockServer::sync(const SData& args,
             SAUTOPREFIX(command->request);
         }
 
+        server._adjustWorkerThreads(workerPoolSample);
+
         // If there were commands waiting on our commit count to come up-to-date, we'll move them back to the main
         // command queue here. There's no place in particular that's best to do this, so we do it at the top of this
         // main loop, as that prevents it from ever getting skipped in the event that we `continue` early from a loop
@@ -743,9 +755,32 @@ void BedrockServer::worker(SQLitePool& dbPool,
     // Worker 0 is the "blockingCommit" thread.
     SInitialize(threadId ? "worker" + to_string(threadId) : "blockingCommit");
 
-    // Get a DB handle to work on. This will automatically be returned when dbScope goes out of scope.
-    SQLiteScopedHandle dbScope(dbPool, dbPool.getIndex());
-    SQLite& db = dbScope.db();
+    while (true) {
+        if (threadId >= server._activeWorkerThreads.load()) {
+            // Wait until we're needed, without holding a DB handle.
+            if (!server._waitWhileParked(threadId)) {
+                return;
+            }
+        }
+
+        // Get a DB handle to work on. This will automatically be returned when dbScope goes out of scope.
+        SQLiteScopedHandle dbScope(dbPool, dbPool.getIndex());
+        if (!_runWorker(dbScope.db(), replicationState, leaderVersion, syncNodeQueuedCommands,
+                        syncNodeCompletedCommands, server, threadId)) {
+            return;
+        }
+        SINFO("Parking worker.");
+    }
+}
+
+bool BedrockServer::_runWorker(SQLite& db,
+                               atomic<SQLiteNode::State>& replicationState,
+                               atomic<string>& leaderVersion,
+                               BedrockTimeoutCommandQueue& syncNodeQueuedCommands,
+                               BedrockTimeoutCommandQueue& syncNodeCompletedCommands,
+                               BedrockServer& server,
+                               int threadId)
+{
     BedrockCore core(db, server);
 
     // Command to work on. This default command is replaced when we find work to do.
@@ -766,6 +801,11 @@ void BedrockServer::worker(SQLitePool& dbPool,
             // Reset this to blank. This releases the existing command and allows it to get cleaned up.
             command = unique_ptr<BedrockCommand>(nullptr);
 
+            // If the pool has shrunk past us, stop here, between commands.
+            if (threadId >= server._activeWorkerThreads.load()) {
+                return true;
+            }
+
             // And get another one.
             command = commandQueue.get(1000000);
 
@@ -801,6 +841,22 @@ void BedrockServer::worker(SQLitePool& dbPool,
                 continue;
             }
 
+            // Likewise, if it's going to time out before we could finish it, turn it away now, rather than spending
+            // time on it that the commands behind it could use.
+            if (server._cannotFinishInTime(command)) {
+                SINFO("Shedding '" << command->request.methodLine << "', it can't finish before its timeout.");
+                server._shedCommandCount++;
+                command->response.methodLine = "503 Server overloaded";
+                command->complete = true;
+                if (command->initiatingPeerID) {
+                    // Escalated command. Give it back to the sync thread to respond.
+                    syncNodeCompletedCommands.push(move(command));
+                } else {
+                    server._reply(command);
+                }
+                continue;
+            }
+
             // Check if this command would be likely to cause a crash
             if (server._wouldCrash(command)) {
                 // If so, make a lot of noise, and respond 500 without processing it.
@@ -833,7 +889,7 @@ void BedrockServer::worker(SQLitePool& dbPool,
                 if (server._shutdownState.load() != RUNNING) {
                     SWARN("Sync thread shut down while were waiting for it to come up. Discarding command '"
                           << command->request.methodLine << "'.");
-                    return;
+                    return false;
                 }
 
                 // This sleep call is pretty ugly, but it should almost never happen. We're accepting the potential
@@ -952,12 +1008,33 @@ void BedrockServer::worker(SQLitePool& dbPool,
                 }
             }
 
+            // If an identical command is already being peeked, we can wait for its answer rather than peeking this one.
+            string singleFlightKey = server._singleFlightKey(command, commitCount);
+            if (!singleFlightKey.empty() && server._joinSingleFlight(singleFlightKey, command)) {
+                continue;
+            }
+
             // We'll retry on conflict up to this many times.
             int retry = server._maxConflictRetries.load();
             while (retry) {
                 // Block if a checkpoint is happening so we don't interrupt it.
                 db.waitForCheckpoint();
 
+                // If this command could write in parallel, stay out of the way of running commands that it tends to
+                // conflict with. This has to happen before we peek, as the peek starts the transaction. A command
+                // other commands are waiting on in `_singleFlights` can't be put back, as it'd end up waiting on
+                // itself.
+                bool deferred = false;
+                TableClaim tableClaim(server, canWriteParallel && threadId ?
+                                              server._claimTables(command->request.methodLine,
+                                                                  !command->conflictDeferred && singleFlightKey.empty(),
+                                                                  deferred) : 0);
+                if (deferred) {
+                    command->conflictDeferred = true;
+                    commandQueue.push(move(command), STimeNow() + CONFLICT_WAIT_US);
+                    break;
+                }
+
                 // If the command has any httpsRequests from a previous `peek`, we won't peek it again unless the
                 // command has specifically asked for that.
                 // If peek succeeds, then it's finished, and all we need to do is respond to the command at the bottom.
@@ -968,6 +1045,13 @@ void BedrockServer::worker(SQLitePool& dbPool,
                     calledPeek = true;
                 }
 
+                // Share the answer with anything that was waiting for this peek.
+                if (!singleFlightKey.empty()) {
+                    bool answered = peekResult == BedrockCore::RESULT::COMPLETE && command->complete;
+                    server._finishSingleFlight(singleFlightKey, answered ? &command->response : nullptr);
+                    singleFlightKey.clear();
+                }
+
                 // This drops us back to the top of the loop.
                 if (peekResult == BedrockCore::RESULT::ABANDONED_FOR_CHECKPOINT) {
                     SINFO("[checkpoint] Re-trying abandoned command (from peek) in worker thread");
@@ -1031,7 +1115,18 @@ void BedrockServer::worker(SQLitePool& dbPool,
                         break;
                     }
 
+                    // Commands that have been conflicting too often are committed one at a time on the blocking
+                    // commit thread until they've calmed down.
+                    if (threadId && server._isAutoBlacklisted(command->request.methodLine)) {
+                        core.rollback();
+                        SINFO("Sending automatically blacklisted command " << command->request.methodLine
+                              << " to blocking queue.");
+                        server._blockingCommandQueue.push(move(command));
+                        break;
+                    }
+
                     // In this case, there's nothing blocking us from processing this in a worker, so let's try it.
+                    const uint64_t processStart = STimeNow();
                     BedrockCore::RESULT result = core.processCommand(command, threadId == 0);
                     if (result == BedrockCore::RESULT::NEEDS_COMMIT) {
                         // If processCommand returned true, then we need to do a commit. Otherwise, the command is
@@ -1065,8 +1160,14 @@ void BedrockServer::worker(SQLitePool& dbPool,
                             } else {
                                 BedrockCore::AutoTimer(command, BedrockCommand::COMMIT_WORKER);
                                 commitSuccess = core.commit(SQLiteNode::stateName(server._replicationState));
+                                server._recordTableAccess(command->request.methodLine, db, !commitSuccess);
+                                if (threadId) {
+                                    server._recordParallelCommit(command->request.methodLine, !commitSuccess,
+                                                                 STimeNow() - processStart);
+                                }
                             }
                         }
+                        server._workerCommits++;
                         if (commitSuccess) {
                             SINFO("Successfully committed " << command->request.methodLine << " on worker thread. blocking: "
                                   << (threadId ? "false" : "true"));
@@ -1075,6 +1176,7 @@ void BedrockServer::worker(SQLitePool& dbPool,
                             command->response["commitCount"] = to_string(db.getCommitCount());
                             command->complete = true;
                         } else {
+                            server._workerConflicts++;
                             SINFO("Conflict or state change committing " << command->request.methodLine
                                   << " on worker thread with " << retry << " retries remaining.");
                         }
@@ -1125,6 +1227,7 @@ void BedrockServer::worker(SQLitePool& dbPool,
 
                 if (!retry) {
                     SINFO("Max retries hit in worker, sending '" << command->request.methodLine << "' to blocking queue.");
+                    server._recordRetriesExhausted(command->request.methodLine);
                    server._blockingCommandQueue.push(move(command));
                 }
             }
@@ -1133,18 +1236,76 @@ void BedrockServer::worker(SQLitePool& dbPool,
             // If the sync node has shut down, we can return now, there will be no more work to do.
             if  (server._shutdownState.load() == DONE) {
                 SINFO("No commands found in queue and DONE.");
-                return;
+                return false;
             }
         }
 
         // If we hit the timeout, doesn't matter if we've got work to do. Exit.
         if (server._gracefulShutdownTimeout.ringing()) {
             SINFO("_shutdownState is DONE and we've timed out, exiting worker.");
-            return;
+            return false;
         }
     }
 }
 
+void BedrockServer::_adjustWorkerThreads(WorkerPoolSample& last) {
+    const uint64_t now = STimeNow();
+    if (_minWorkerThreads == _maxWorkerThreads || now < last.time + WORKER_ADJUSTMENT_INTERVAL_US) {
+        return;
+    }
+
+    // How busy we've been since last time.
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    const uint64_t cpuUS = usage.ru_utime.tv_sec * STIME_US_PER_S + usage.ru_utime.tv_usec +
+                           usage.ru_stime.tv_sec * STIME_US_PER_S + usage.ru_stime.tv_usec;
+    const double cpuUtilization = (double)(cpuUS - last.cpuUS) / (now - last.time) /
+                                  max(1u, thread::hardware_concurrency());
+    const uint64_t commits = _workerCommits.load();
+    const uint64_t conflicts = _workerConflicts.load();
+    const double conflictRate = commits > last.commits ?
+                                (double)(conflicts - last.conflicts) / (commits - last.commits) : 0;
+    const uint64_t queueDelay = _commandQueue.standingDelay();
+    const bool firstSample = !last.time;
+    last = {now, cpuUS, commits, conflicts};
+    if (firstSample) {
+        return;
+    }
+
+    // Conflicts mean workers are redoing each other's work, so more of them makes it worse. Otherwise, if commands
+    // are waiting and there's CPU to spare, another worker can help, and once nothing's waiting, we give one back.
+    const int active = _activeWorkerThreads.load();
+    int target = active;
+    if (conflictRate > WORKER_MAX_CONFLICT_RATE) {
+        target = max(active - 1, _minWorkerThreads);
+    } else if (queueDelay > WORKER_QUEUE_TARGET_US && cpuUtilization < WORKER_MAX_CPU_UTILIZATION) {
+        target = min(active + 1, _maxWorkerThreads);
+    } else if (!queueDelay && _commandQueue.empty()) {
+        target = max(active - 1, _minWorkerThreads);
+    }
+    if (target != active) {
+        SINFO("Changing active worker threads from " << active << " to " << target << " (queue delay " << queueDelay
+              << "us, conflict rate " << conflictRate << ", CPU utilization " << cpuUtilization << ").");
+        {
+            lock_guard<mutex> lock(_parkedWorkerMutex);
+            _activeWorkerThreads.store(target);
+        }
+        _parkedWorkerCV.notify_all();
+    }
+}
+
+bool BedrockServer::_waitWhileParked(int threadId) {
+    unique_lock<mutex> lock(_parkedWorkerMutex);
+    while (threadId >= _activeWorkerThreads.load()) {
+        // Parked workers still need to notice the server shutting down, like the others do when they find no work.
+        if (_shutdownState.load() == DONE || _gracefulShutdownTimeout.ringing()) {
+            return false;
+        }
+        _parkedWorkerCV.wait_for(lock, chrono::seconds(1));
+    }
+    return true;
+}
+
 bool BedrockServer::_handleIfStatusOrControlCommand(unique_ptr<BedrockCommand>& command) {
     if (_isStatusCommand(command)) {
         _status(command);
@@ -1232,16 +1393,32 @@ void BedrockServer::_resetServer() {
     }
 }
 
-BedrockServer::BedrockServer(SQLiteNode::State state, const SData& args_) : SQLiteServer(""), args(args_), _replicationState(SQLiteNode::LEADING)
-{}
+BedrockServer::BedrockServer(SQLiteNode::State state, const SData& args_)
+  : SQLiteServer(""), args(args_), _blockingCommandQueue(1), _replicationState(SQLiteNode::LEADING),
+    _autoBlacklistConflictRate(0),
+    _admissionTargetUS(0), _shedCommandCount(0), _deadlineScheduling(false), _singleFlightReads(false),
+    _singleFlightExecutions(0), _singleFlightMerged(0), _conflictAwareScheduling(false), _lastTableClaim(0),
+    _conflictWaits(0), _minWorkerThreads(0), _maxWorkerThreads(0), _activeWorkerThreads(0), _workerCommits(0),
+    _workerConflicts(0)
+{
+    _clientSocketOwners.emplace_back(make_unique<ClientSocketOwner>(0));
+}
 
 BedrockServer::BedrockServer(const SData& args_)
-  : SQLiteServer(""), shutdownWhileDetached(false), args(args_), _requestCount(0), _replicationState(SQLiteNode::SEARCHING),
+  : SQLiteServer(""), shutdownWhileDetached(false), args(args_), _commandQueue(max(0, args.calc("-workerThreads"))),
+    _blockingCommandQueue(1), _requestCount(0), _lastChance(0),
+    _replicationState(SQLiteNode::SEARCHING),
     _upgradeInProgress(false), _suppressCommandPort(false), _suppressCommandPortManualOverride(false),
-    _syncThreadComplete(false), _syncNode(nullptr), _shutdownState(RUNNING),
+    _syncThreadComplete(false), _syncNode(nullptr),
+    _autoBlacklistConflictRate(SToFloat(args["-autoBlacklistConflictRate"])),
+    _shutdownState(RUNNING),
     _multiWriteEnabled(args.test("-enableMultiWrite")), _shouldBackup(false), _detach(args.isSet("-bootstrap")),
     _controlPort(nullptr), _commandPort(nullptr), _maxConflictRetries(3), _lastQuorumCommandTime(STimeNow()),
-    _pluginsDetached(false)
+    _pluginsDetached(false), _admissionTargetUS(max(0, args.calc("-admissionTargetMS")) * 1000ull),
+    _shedCommandCount(0), _deadlineScheduling(args.test("-deadlineScheduling")),
+    _singleFlightReads(args.test("-singleFlightReads")), _singleFlightExecutions(0), _singleFlightMerged(0),
+    _conflictAwareScheduling(args.test("-conflictAwareScheduling")), _lastTableClaim(0), _conflictWaits(0),
+    _minWorkerThreads(0), _maxWorkerThreads(0), _activeWorkerThreads(0), _workerCommits(0), _workerConflicts(0)
 {
     _version = VERSION;
 
@@ -1289,6 +1466,9 @@ BedrockServer::BedrockServer(const SData& args_)
         SQLite::enableTrace.store(true);
     }
 
+    // Group commit needs to be set before any DB handles are opened.
+    SQLite::groupCommitWindowUS.store(max(0, args.calc("-groupCommitWindowUS")));
+
     // Bypass journald.
     if (args.isSet("-logDirectlyToSyslogSocket")) {
         SSyslogFunc = &SSyslogSocketDirect;
@@ -1313,6 +1493,19 @@ BedrockServer::BedrockServer(const SData& args_)
         }
     }
 
+    // Configure fair queuing between clients or commands at the same priority.
+    map<string, size_t> flowWeights;
+    for (const string& flowWeight : SParseList(args["-fairQueueWeights"])) {
+        list<string> parts = SParseList(flowWeight, ':');
+        if (parts.size() == 2) {
+            flowWeights[parts.front()] = max((int64_t)1, SToInt64(parts.back()));
+        } else {
+            SWARN("Ignoring malformed -fairQueueWeights entry '" << flowWeight << "'.");
+        }
+    }
+    _commandQueue.configureFlows(args["-fairQueueFlowHeader"], args.test("-fairQueueing"), flowWeights);
+    _commandQueue.setDeadlineOrdering(_deadlineScheduling);
+
     // Allow sending control commands when the server's not LEADING/FOLLOWING.
     SINFO("Opening control port on '" << args["-controlPort"] << "'");
     _controlPort = openPort(args["-controlPort"]);
@@ -1323,9 +1516,21 @@ BedrockServer::BedrockServer(const SData& args_)
         SINFO("Bootstrap flag detected, starting sync node in detach mode.");
     }
 
+    // Allow clients to pipeline requests, if configured.
+    _maxPipelinedRequests = max(1, args.calc("-maxPipelinedRequests"));
+
     // Set the quorum checkpoint, or default if not specified.
     _quorumCheckpointSeconds = args.isSet("-quorumCheckpointSeconds") ? args.calc("-quorumCheckpointSeconds") : 60;
 
+    // Start any client I/O threads. Until these exist, the main thread handles all client sockets itself. This has to
+    // happen before we start the sync thread, as its workers read `_clientSocketOwners` to route replies.
+    _clientSocketOwners.emplace_back(make_unique<ClientSocketOwner>(0));
+    int clientIOThreads = max(0, args.calc("-clientIOThreads"));
+    for (int i = 0; i < clientIOThreads; i++) {
+        _clientSocketOwners.emplace_back(make_unique<ClientSocketOwner>(i + 1));
+        _clientIOThreads.emplace_back(make_unique<ClientIOThread>(*this, i, *_clientSocketOwners.back()));
+    }
+
     // Start the sync thread, which will start the worker threads.
     SINFO("Launching sync thread '" << _syncThreadName << "'");
     _syncThread = thread(syncWrapper,
@@ -1344,18 +1549,22 @@ BedrockServer::~BedrockServer() {
     }
     SINFO("Threads closed.");
 
-    // Close any sockets that are still open. We wait until the sync thread has completed to do this, as until it's
-    // finished, it may keep writing to these sockets.
-    if (_socketIDMap.size()) {
-        SWARN("Still have " << _socketIDMap.size() << " entries in _socketIDMap.");
+    // Stop the client I/O threads. Each of these closes its own remaining sockets.
+    _clientIOThreads.clear();
+
+    // Send any replies that were queued after the main thread's last poll, then close any sockets that are still
+    // open. We wait until the sync thread has completed to do this, as until it's finished, it may keep queuing
+    // replies for these sockets.
+    ClientSocketOwner& mainOwner = *_clientSocketOwners.front();
+    _sendReplies(mainOwner);
+    if (mainOwner.socketIDMap.size()) {
+        SWARN("Still have " << mainOwner.socketIDMap.size() << " entries in socketIDMap.");
     }
 
     if (socketList.size()) {
         SWARN("Still have " << socketList.size() << " entries in socketList.");
-        for (list<Socket*>::iterator socketIt = socketList.begin(); socketIt != socketList.end();) {
-            // Shut it down and go to the next (because closeSocket will invalidate this iterator otherwise)
-            Socket* s = *socketIt++;
-            closeSocket(s);
+        while (socketList.size()) {
+            closeSocket(socketList.front());
         }
     }
 
@@ -1418,16 +1627,23 @@ bool BedrockServer::shutdownComplete() {
 }
 
 void BedrockServer::prePoll(fd_map& fdm) {
-    SAUTOLOCK(_socketIDMutex);
+    _clientSocketOwners.front()->replies.prePoll(fdm);
+    _mainThreadCommands.prePoll(fdm);
     STCPServer::prePoll(fdm);
 }
 
 void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
-    // Let the base class do its thing. We lock around this because we allow worker threads to modify the sockets (by
-    // writing to them, but this can truncate send buffers).
-    {
-        SAUTOLOCK(_socketIDMutex);
-        STCPServer::postPoll(fdm);
+    // Let the base class do its thing, then send any responses that workers have finished since the last time.
+    STCPServer::postPoll(fdm);
+    _clientSocketOwners.front()->replies.postPoll(fdm);
+    _sendReplies(*_clientSocketOwners.front());
+
+    // Run any status and control commands that client I/O threads have handed us.
+    _mainThreadCommands.postPoll(fdm);
+    while (!_mainThreadCommands.empty()) {
+        unique_ptr<BedrockCommand> command = _mainThreadCommands.pop();
+        SAUTOPREFIX(command->request);
+        _handleIfStatusOrControlCommand(command);
     }
 
     // Open the port the first time we enter a command-processing state
@@ -1489,160 +1705,79 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
         }
     }
 
+    // Accept any new connections
+    _acceptSockets();
+
+    // Process any new activity from incoming sockets.
+    _readClientRequests(*this, *_clientSocketOwners.front());
+
+    // If any plugin timers are firing, let the plugins know.
+    for (auto plugin : plugins) {
+        for (SStopwatch* timer : plugin.second->timers) {
+            if (timer->ding()) {
+                plugin.second->timerFired(timer);
+            }
+        }
+    }
+
+    // If we've been told to start shutting down, we'll set the lastChance timer.
+    if (_shutdownState.load() == START_SHUTDOWN) {
+        if (!_lastChance.load()) {
+            _lastChance.store(STimeNow() + 5 * 1'000'000); // 5 seconds from now.
+        }
+        // If we've run out of sockets or hit our timeout, we'll increment _shutdownState. Any client I/O threads will
+        // close their own remaining sockets when they see this.
+        if (!_clientSocketCount() || _gracefulShutdownTimeout.ringing()) {
+            _lastChance.store(0);
+
+            // We empty the socket list here, we will no longer allow new requests to come in, as the sync node can
+            // shutdown any time after here, and we'll have no way to handle new requests.
+            if (socketList.size()) {
+                SINFO("Killing " << socketList.size() << " remaining sockets at graceful shutdown timeout.");
+                while(socketList.size()) {
+                    auto s = socketList.front();
+                    _clientSocketOwners.front()->socketIDMap.erase(s->id);
+                    closeSocket(s);
+                }
+            }
+            _shutdownState.store(CLIENTS_RESPONDED);
+        }
+    }
+}
+
+void BedrockServer::_readClientRequests(STCPManager& manager, ClientSocketOwner& owner) {
     // Timing variables.
     int deserializationAttempts = 0;
     int deserializedRequests = 0;
 
-    // Accept any new connections
-    _acceptSockets();
-
-    // Time the end of the accept section.
-    uint64_t acceptEndTime = STimeNow();
+    // Time the start of the read section.
+    uint64_t readStartTime = STimeNow();
 
     // Process any new activity from incoming sockets. In order to not modify the socket list while we're iterating
     // over it, we'll keep a list of sockets that need closing.
     list<STCPManager::Socket*> socketsToClose;
 
-    // This is a timestamp, after which we'll start giving up on any sockets that don't seem to be giving us any data.
-    // The case for this is that once we start shutting down, we'll close any sockets when we respond to a command on
-    // them, and we'll stop accepting any new sockets, but if existing sockets just sit around giving us nothing, we
-    // need to figure out some way to handle them. We'll wait 5 seconds and then start killing them.
-    static uint64_t lastChance = 0;
-    for (auto s : socketList) {
+    // `_lastChance` is a timestamp, after which we'll start giving up on any sockets that don't seem to be giving us
+    // any data. The case for this is that once we start shutting down, we'll close any sockets when we respond to a
+    // command on them, and we'll stop accepting any new sockets, but if existing sockets just sit around giving us
+    // nothing, we need to figure out some way to handle them. We'll wait 5 seconds and then start killing them.
+    const uint64_t lastChance = _lastChance.load();
+    for (auto s : manager.socketList) {
         switch (s->state.load()) {
             case STCPManager::Socket::CLOSED:
             {
                 // TODO: Cancel any outstanding commands initiated by this socket. This isn't critical, and is an
                 // optimization. Otherwise, they'll continue to get processed to completion, and will just never be
                 // able to have their responses returned.
-                SAUTOLOCK(_socketIDMutex);
-                _socketIDMap.erase(s->id);
+                owner.socketIDMap.erase(s->id);
                 socketsToClose.push_back(s);
             }
             break;
             case STCPManager::Socket::CONNECTED:
             {
-                {
-                    SAUTOLOCK(_socketIDMutex);
-                    if (s->recvBuffer.empty()) {
-                        // If nothing's been received, break early.
-                        if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && _socketIDMap.find(s->id) == _socketIDMap.end()) {
-                            // If we're shutting down and past our lastChance timeout, we start killing these.
-                            SINFO("Closing socket " << s->id << " with no data and no pending command: shutting down.");
-                            socketsToClose.push_back(s);
-                        }
-                        break;
-                    } else {
-                        // Otherwise, we'll see if there's any activity on this socket. Currently, we don't handle clients
-                        // pipelining requests well. We process commands in no particular order, so we can't dequeue two
-                        // requests off the same socket at one time, or we don't guarantee their return order, thus we just
-                        // wait and will try again later.
-                        auto socketIt = _socketIDMap.find(s->id);
-                        if (socketIt != _socketIDMap.end()) {
-                            break;
-                        }
-                    }
-                }
-
-                // If there's a request, we'll dequeue it (but only the first one).
-                SData request;
-
-                // If the socket is owned by a plugin, we let the plugin populate our request.
-                BedrockPlugin* plugin = static_cast<BedrockPlugin*>(s->data);
-                if (plugin) {
-                    // Call the plugin's handler.
-                    plugin->onPortRecv(s, request);
-                    if (!request.empty()) {
-                        // If it populated our request, then we'll save the plugin name so we can handle the response.
-                        request["plugin"] = plugin->getName();
-                    }
-                } else {
-                    // Otherwise, handle any default request.
-                    int requestSize = request.deserialize(s->recvBuffer);
-                    s->recvBuffer.consumeFront(requestSize);
-                    deserializationAttempts++;
-                }
-
-                // If we have a populated request, from either a plugin or our default handling, we'll queue up the
-                // command.
-                if (!request.empty()) {
-                    SAUTOPREFIX(request);
-                    deserializedRequests++;
-                    // Either shut down the socket or store it so we can eventually sync out the response.
-                    if (SIEquals(request["Connection"], "forget") ||
-                        (uint64_t)request.calc64("commandExecuteTime") > STimeNow()) {
-                        // Respond immediately to make it clear we successfully queued it, but don't add to the socket
-                        // map as we don't care about the answer.
-                        SINFO("Firing and forgetting '" << request.methodLine << "'");
-                        SData response("202 Successfully queued");
-                        if (_shutdownState.load() != RUNNING) {
-                            response["Connection"] = "close";
-                        }
-                        s->send(response.serialize());
-
-                        // If we're shutting down, discard this command, we won't wait for the future.
-                        if (_shutdownState.load() != RUNNING) {
-                            SINFO("Not queuing future command '" << request.methodLine << "' while shutting down.");
-                            break;
-                        }
-                    } else {
-                        SINFO("Waiting for '" << request.methodLine << "' to complete.");
-                        SAUTOLOCK(_socketIDMutex);
-                        _socketIDMap[s->id] = s;
-                    }
-
-                    // Get the source ip of the command.
-                    char *ip = inet_ntoa(s->addr.sin_addr);
-                    if (ip != "127.0.0.1"s) {
-                        // We only add this if it's not localhost because existing code expects commands that come from
-                        // localhost to have it blank.
-                        request["_source"] = ip;
-                    }
-
-                    // Create a command.
-                    unique_ptr<BedrockCommand> command = getCommandFromPlugins(move(request));
-
-                    if (command->writeConsistency != SQLiteNode::QUORUM
-                        && _syncCommands.find(command->request.methodLine) != _syncCommands.end()) {
-
-                        command->writeConsistency = SQLiteNode::QUORUM;
-                        _lastQuorumCommandTime = STimeNow();
-                        SINFO("Forcing QUORUM consistency for command " << command->request.methodLine);
-                    }
-
-                    // This is important! All commands passed through the entire cluster must have unique IDs, or they
-                    // won't get routed properly from follower to leader and back.
-                    command->id = args["-nodeName"] + "#" + to_string(_requestCount++);
-
-                    // And we and keep track of the client that initiated this command, so we can respond later, except
-                    // if we received connection:forget in which case we don't respond later
-                    command->initiatingClientID = SIEquals(command->request["Connection"], "forget") ? -1 : s->id;
-
-                    // If it's a status or control command, we handle it specially there. If not, we'll queue it for
-                    // later processing.
-                    if (!_handleIfStatusOrControlCommand(command)) {
-                        auto _syncNodeCopy = atomic_load(&_syncNode);
-                        if (_syncNodeCopy && _syncNodeCopy->getState() == SQLiteNode::STANDINGDOWN) {
-                            _standDownQueue.push(move(command));
-                        } else {
-                            if (_version != _leaderVersion.load()) {
-                                SINFO("Immediately escalating " << command->request.methodLine << " to leader due to version mismatch.");
-                                _syncNodeQueuedCommands.push(move(command));
-                            } else {
-                                SINFO("Queued new '" << command->request.methodLine << "' command from local client, with "
-                                      << _commandQueue.size() << " commands already queued.");
-                                _commandQueue.push(move(command));
-                            }
-                        }
-                    }
-                } else {
-                    SAUTOLOCK(_socketIDMutex);
-                    // If we weren't able to deserialize a complete request, and we're shutting down, give up.
-                    if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && _socketIDMap.find(s->id) == _socketIDMap.end()) {
-                        SINFO("Closing socket " << s->id << " with incomplete data and no pending command: shutting down.");
-                        socketsToClose.push_back(s);
-                    }
-                }
+                // Clients may pipeline requests, so we keep reading requests off this socket until it has no more
+                // complete ones, or has as many outstanding as we allow.
+                while (_readClientRequest(owner, s, socketsToClose, lastChance, deserializationAttempts, deserializedRequests)) {}
             }
             break;
             case STCPManager::Socket::SHUTTINGDOWN:
@@ -1660,47 +1795,476 @@ void BedrockServer::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     }
 
     // Log the timing of this loop.
-    uint64_t readElapsedMS = (STimeNow() - acceptEndTime) / 1000;
-    SINFO("[performance] Read from " << socketList.size() << " sockets, attempted to deserialize " << deserializationAttempts
+    uint64_t readElapsedMS = (STimeNow() - readStartTime) / 1000;
+    SINFO("[performance] Read from " << manager.socketList.size() << " sockets, attempted to deserialize " << deserializationAttempts
           << " commands, " << deserializedRequests << " were complete and deserialized in " << readElapsedMS << "ms.");
 
     // Now we can close any sockets that we need to.
     for (auto s: socketsToClose) {
-        closeSocket(s);
+        manager.closeSocket(s);
     }
+}
 
-    // If any plugin timers are firing, let the plugins know.
-    for (auto plugin : plugins) {
-        for (SStopwatch* timer : plugin.second->timers) {
-            if (timer->ding()) {
-                plugin.second->timerFired(timer);
+bool BedrockServer::_readClientRequest(ClientSocketOwner& owner, STCPManager::Socket* s,
+                                       list<STCPManager::Socket*>& socketsToClose, uint64_t lastChance,
+                                       int& deserializationAttempts, int& deserializedRequests) {
+    {
+        ClientSocketState* state = owner.socketIDMap.find(s->id);
+        if (s->recvBuffer.empty()) {
+            // If nothing's been received, break early.
+            if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && !state) {
+                // If we're shutting down and past our lastChance timeout, we start killing these.
+                SINFO("Closing socket " << s->id << " with no data and no pending command: shutting down.");
+                socketsToClose.push_back(s);
+            }
+            return false;
+        } else if (state) {
+            // Otherwise, we'll see if we can take another request from this socket. Clients can pipeline requests up
+            // to `_maxPipelinedRequests`, as `_reply` sends responses back in request order. Plugins send their own
+            // responses, which we can't reorder, so their sockets get one request at a time.
+            if (s->data || state->nextRequestSequence - state->nextReplySequence >= _maxPipelinedRequests) {
+                return false;
             }
         }
     }
 
-    // If we've been told to start shutting down, we'll set the lastChance timer.
-    if (_shutdownState.load() == START_SHUTDOWN) {
-        if (!lastChance) {
-            lastChance = STimeNow() + 5 * 1'000'000; // 5 seconds from now.
+    // If there's a request, we'll dequeue it.
+    SData request;
+    uint64_t sequence = 0;
+    bool binary = false;
+
+    // If the socket is owned by a plugin, we let the plugin populate our request.
+    BedrockPlugin* plugin = static_cast<BedrockPlugin*>(s->data);
+    if (plugin) {
+        // Call the plugin's handler.
+        plugin->onPortRecv(s, request);
+        if (!request.empty()) {
+            // If it populated our request, then we'll save the plugin name so we can handle the response.
+            request["plugin"] = plugin->getName();
         }
-        // If we've run out of sockets or hit our timeout, we'll increment _shutdownState.
-        if (socketList.empty() || _gracefulShutdownTimeout.ringing()) {
-            lastChance = 0;
+    } else {
+        // Otherwise, handle any default request. Clients can send each request as either text or a binary frame,
+        // which we can tell apart by the first byte.
+        binary = SData::isBinary(s->recvBuffer.c_str(), s->recvBuffer.size());
+        int requestSize;
+        if (binary) {
+            requestSize = request.deserializeBinary(s->recvBuffer.c_str(), s->recvBuffer.size());
+        } else {
+            requestSize = request.deserialize(s->recvBuffer, s->recvParser);
+        }
+        deserializationAttempts++;
+        if (requestSize < 0) {
+            // There's no way to find the start of the next request after a malformed frame, so give up on the socket.
+            SWARN("Malformed binary request from socket " << s->id << ", shutting it down.");
+            s->recvBuffer.clear();
+            s->recvParser.reset();
+            shutdownSocket(s, SHUT_RDWR);
+            return false;
+        }
+        s->recvBuffer.consumeFront(requestSize);
+    }
+
+    // If we have a populated request, from either a plugin or our default handling, we'll queue up the
+    // command.
+    if (!request.empty()) {
+        SAUTOPREFIX(request);
+        deserializedRequests++;
+        // Either shut down the socket or store it so we can eventually sync out the response.
+        const bool answered = SIEquals(request["Connection"], "forget") ||
+                              (uint64_t)request.calc64("commandExecuteTime") > STimeNow();
+        if (answered) {
+            // Respond immediately to make it clear we successfully queued it, but don't add to the socket
+            // map as we don't care about the answer.
+            SINFO("Firing and forgetting '" << request.methodLine << "'");
+            SData response("202 Successfully queued");
+            if (_shutdownState.load() != RUNNING) {
+                response["Connection"] = "close";
+            }
+            {
+                // If there are earlier requests from this socket still in progress, this response has to wait its turn.
+                ClientSocketState* state = owner.socketIDMap.find(s->id);
+                string serialized = binary ? response.serializeBinary() : response.serialize();
+                if (state) {
+                    _sendInOrder(owner, *state, state->nextRequestSequence++, {move(serialized)}, false);
+                } else {
+                    s->send(serialized);
+                }
+            }
 
-            // We empty the socket list here, we will no longer allow new requests to come in, as the sync node can
-            // shutdown any time after here, and we'll have no way to handle new requests.
-            if (socketList.size()) {
-                SAUTOLOCK(_socketIDMutex);
-                SINFO("Killing " << socketList.size() << " remaining sockets at graceful shutdown timeout.");
-                while(socketList.size()) {
-                    auto s = socketList.front();
-                    _socketIDMap.erase(s->id);
-                    closeSocket(s);
+            // If we're shutting down, discard this command, we won't wait for the future.
+            if (_shutdownState.load() != RUNNING) {
+                SINFO("Not queuing future command '" << request.methodLine << "' while shutting down.");
+                return false;
+            }
+        } else {
+            SINFO("Waiting for '" << request.methodLine << "' to complete.");
+            ClientSocketState* state = owner.socketIDMap.find(s->id);
+            if (!state) {
+                state = &owner.socketIDMap.insert(s->id, ClientSocketState(s));
+            }
+            sequence = state->nextRequestSequence++;
+        }
+
+        // Get the source ip of the command.
+        char *ip = inet_ntoa(s->addr.sin_addr);
+        if (ip != "127.0.0.1"s) {
+            // We only add this if it's not localhost because existing code expects commands that come from
+            // localhost to have it blank.
+            request["_source"] = ip;
+        }
+
+        // Create a command.
+        unique_ptr<BedrockCommand> command = getCommandFromPlugins(move(request));
+
+        if (command->writeConsistency != SQLiteNode::QUORUM
+            && _syncCommands.find(command->request.methodLine) != _syncCommands.end()) {
+
+            command->writeConsistency = SQLiteNode::QUORUM;
+            _lastQuorumCommandTime = STimeNow();
+            SINFO("Forcing QUORUM consistency for command " << command->request.methodLine);
+        }
+
+        // This is important! All commands passed through the entire cluster must have unique IDs, or they
+        // won't get routed properly from follower to leader and back.
+        command->id = args["-nodeName"] + "#" + to_string(_requestCount++);
+
+        // And we and keep track of the client that initiated this command, so we can respond later, except if we've
+        // already answered it above, in which case we don't respond later. The client's next request may be waiting on
+        // a reply in the same place in the order, which must not be confused with this one.
+        command->initiatingClientID = answered ? -1 : s->id;
+        command->initiatingClientSequence = sequence;
+        command->initiatingClientOwner = owner.index;
+        command->initiatingClientBinary = binary;
+
+        // If it's a status or control command, we handle it specially there, on the main thread. If not, we'll
+        // queue it for later processing.
+        if (owner.index && (_isStatusCommand(command) || _isControlCommand(command))) {
+            _mainThreadCommands.push(move(command));
+        } else if (!_handleIfStatusOrControlCommand(command)) {
+            auto _syncNodeCopy = atomic_load(&_syncNode);
+            if (_syncNodeCopy && _syncNodeCopy->getState() == SQLiteNode::STANDINGDOWN) {
+                _standDownQueue.push(move(command));
+            } else {
+                if (_version != _leaderVersion.load()) {
+                    SINFO("Immediately escalating " << command->request.methodLine << " to leader due to version mismatch.");
+                    _syncNodeQueuedCommands.push(move(command));
+                } else if (_shouldShed(command)) {
+                    // Tell the client right away, rather than making it wait to time out behind everything else.
+                    SINFO("Shedding '" << command->request.methodLine << "' with priority " << command->priority
+                          << ", command queue is overloaded.");
+                    _shedCommandCount++;
+                    command->response.methodLine = "503 Server overloaded";
+                    command->response["Retry-After"] = "1";
+                    _reply(command);
+                } else {
+                    SINFO("Queued new '" << command->request.methodLine << "' command from local client, with "
+                          << _commandQueue.size() << " commands already queued.");
+                    _commandQueue.push(move(command));
                 }
             }
-            _shutdownState.store(CLIENTS_RESPONDED);
         }
+        return true;
+    } else {
+        // If we weren't able to deserialize a complete request, and we're shutting down, give up.
+        if (_shutdownState.load() != RUNNING && lastChance && lastChance < STimeNow() && !owner.socketIDMap.find(s->id)) {
+            SINFO("Closing socket " << s->id << " with incomplete data and no pending command: shutting down.");
+            socketsToClose.push_back(s);
+        }
+    }
+    return false;
+}
+
+bool BedrockServer::_shouldShed(const unique_ptr<BedrockCommand>& command) {
+    // We only turn away commands with a client waiting for the answer, and never scheduled commands, which the client
+    // has already been told were queued.
+    if (!_admissionTargetUS || command->initiatingClientID <= 0 || command->priority >= BedrockCommand::PRIORITY_MAX ||
+        command->request.isSet("commandExecuteTime")) {
+        return false;
+    }
+    uint64_t delay = _commandQueue.standingDelay();
+    if (delay <= _admissionTargetUS) {
+        return false;
+    }
+
+    // Past the target, we turn away anything below normal priority, past twice the target, anything below high
+    // priority, and past four times the target, everything but PRIORITY_MAX.
+    BedrockCommand::Priority threshold = BedrockCommand::PRIORITY_NORMAL;
+    if (delay > _admissionTargetUS * 4) {
+        threshold = BedrockCommand::PRIORITY_MAX;
+    } else if (delay > _admissionTargetUS * 2) {
+        threshold = BedrockCommand::PRIORITY_HIGH;
+    }
+    return command->priority < threshold;
+}
+
+void BedrockServer::_recordServiceTime(const unique_ptr<BedrockCommand>& command) {
+    // Only commands that were actually worked on tell us anything.
+    if (!_deadlineScheduling || !command->peekCount) {
+        return;
+    }
+
+    // Everything since a worker first dequeued the command, except for any time it spent back in the worker queue.
+    // Time before that is spent waiting, and `_cannotFinishInTime` already counts it, as it looks at the time now.
+    const uint64_t now = STimeNow();
+    uint64_t dequeued = 0;
+    uint64_t requeuedTime = 0;
+    for (const auto& timing : command->timingInfo) {
+        if (get<0>(timing) == BedrockCommand::QUEUE_WORKER) {
+            if (!dequeued) {
+                dequeued = get<2>(timing);
+            } else {
+                requeuedTime += get<2>(timing) - get<1>(timing);
+            }
+        }
+    }
+    if (!dequeued || dequeued > now) {
+        return;
+    }
+    const uint64_t serviceTime = now - dequeued - min(now - dequeued, requeuedTime);
+    const string name = command->request.getVerb();
+    lock_guard<mutex> lock(_serviceTimeMutex);
+    auto it = _serviceTimes.find(name);
+    if (it != _serviceTimes.end()) {
+        it->second = {(it->second.estimateUS * 7 + serviceTime) / 8, now};
+    } else if (_serviceTimes.size() < MAX_SERVICE_TIME_NAMES) {
+        _serviceTimes.emplace(name, ServiceTime{serviceTime, now});
+    }
+}
+
+bool BedrockServer::_cannotFinishInTime(const unique_ptr<BedrockCommand>& command) {
+    // Once a command's been peeked, it may have work in progress (e.g., HTTPS requests), so we let it finish.
+    if (!_deadlineScheduling || command->peekCount) {
+        return false;
+    }
+    const uint64_t now = STimeNow();
+    lock_guard<mutex> lock(_serviceTimeMutex);
+    auto it = _serviceTimes.find(command->request.getVerb());
+    if (it == _serviceTimes.end() || now + it->second.estimateUS <= command->timeout()) {
+        return false;
+    }
+
+    // If the estimate's gone stale, this one goes ahead to find out if it's still right. Marking the estimate as
+    // updated keeps the commands behind it from doing the same until it's answered.
+    if (now - min(now, it->second.updated) > SERVICE_TIME_PROBE_US) {
+        it->second.updated = now;
+        return false;
+    }
+    return true;
+}
+
+string BedrockServer::_singleFlightKey(const unique_ptr<BedrockCommand>& command, uint64_t commitCount) {
+    // Only client commands that haven't been worked on yet can share a peek.
+    if (!_singleFlightReads || command->initiatingClientID <= 0 || command->initiatingPeerID ||
+        command->singleFlightReleased || command->peekCount || command->httpsRequests.size()) {
+        return "";
+    }
+
+    // Everything that could change the answer, which is everything in the request but what identifies this particular
+    // request, or only affects how long the caller waits.
+    static const set<string> ignoredHeaders = {"requestID", "Connection", "timeout", "commandExecuteTime"};
+    string key = to_string(commitCount) + "\n" + command->request.methodLine + "\n";
+    for (const auto& header : command->request.nameValueMap) {
+        if (!ignoredHeaders.count(header.first)) {
+            key += header.first + ": " + header.second + "\n";
+        }
+    }
+    return key + "\n" + command->request.content;
+}
+
+bool BedrockServer::_joinSingleFlight(const string& key, unique_ptr<BedrockCommand>& command) {
+    lock_guard<mutex> lock(_singleFlightMutex);
+    auto flight = _singleFlights.find(key);
+    if (flight == _singleFlights.end()) {
+        _singleFlights.emplace(key, list<unique_ptr<BedrockCommand>>());
+        _singleFlightExecutions++;
+        return false;
+    }
+    SINFO("Waiting for identical '" << command->request.methodLine << "' command already in progress.");
+    flight->second.push_back(move(command));
+    _singleFlightMerged++;
+    return true;
+}
+
+void BedrockServer::_finishSingleFlight(const string& key, const SData* response) {
+    list<unique_ptr<BedrockCommand>> waiters;
+    {
+        lock_guard<mutex> lock(_singleFlightMutex);
+        auto flight = _singleFlights.find(key);
+        if (flight == _singleFlights.end()) {
+            return;
+        }
+        waiters = move(flight->second);
+        _singleFlights.erase(flight);
+    }
+    for (auto& waiter : waiters) {
+        if (response) {
+            waiter->response = *response;
+            waiter->complete = true;
+            _reply(waiter);
+        } else {
+            waiter->singleFlightReleased = true;
+            _commandQueue.push(move(waiter));
+        }
+    }
+}
+
+void BedrockServer::_decayConflictRate(const string& methodLine, ParallelCommandStats& stats, uint64_t now) {
+    if (now > stats.updated) {
+        stats.conflictRate *= exp2(-(double)(now - stats.updated) / AUTO_BLACKLIST_HALF_LIFE_US);
+        stats.updated = now;
+    }
+    if (stats.blacklisted && stats.conflictRate < _autoBlacklistConflictRate / 2) {
+        SINFO("Conflict rate for '" << methodLine << "' is down to " << stats.conflictRate
+              << ", removing it from the automatic blacklist.");
+        stats.blacklisted = false;
+    }
+}
+
+void BedrockServer::_recordParallelCommit(const string& methodLine, bool conflicted, uint64_t processUS) {
+    if (_autoBlacklistConflictRate <= 0) {
+        return;
+    }
+    const uint64_t now = STimeNow();
+    lock_guard<mutex> lock(_parallelCommandStatsMutex);
+    auto it = _parallelCommandStats.find(methodLine);
+    if (it == _parallelCommandStats.end()) {
+        if (_parallelCommandStats.size() >= MAX_PARALLEL_COMMAND_STATS) {
+            return;
+        }
+        it = _parallelCommandStats.emplace(methodLine, ParallelCommandStats{0, 0, 0, 0, 0, now, false}).first;
+    }
+    ParallelCommandStats& stats = it->second;
+    _decayConflictRate(methodLine, stats, now);
+    stats.commits++;
+    stats.conflicts += conflicted ? 1 : 0;
+    stats.processUS += processUS;
+    stats.conflictRate = (stats.conflictRate * 15 + (conflicted ? 1 : 0)) / 16;
+    if (!stats.blacklisted && stats.commits >= AUTO_BLACKLIST_MIN_COMMITS &&
+        stats.conflictRate >= _autoBlacklistConflictRate) {
+        SWARN("Conflict rate for '" << methodLine << "' is " << stats.conflictRate
+              << ", automatically blacklisting it from parallel commits.");
+        stats.blacklisted = true;
+    }
+}
+
+void BedrockServer::_recordRetriesExhausted(const string& methodLine) {
+    lock_guard<mutex> lock(_parallelCommandStatsMutex);
+    auto it = _parallelCommandStats.find(methodLine);
+    if (it != _parallelCommandStats.end()) {
+        it->second.retriesExhausted++;
+    }
+}
+
+bool BedrockServer::_isAutoBlacklisted(const string& methodLine) {
+    if (_autoBlacklistConflictRate <= 0) {
+        return false;
+    }
+    lock_guard<mutex> lock(_parallelCommandStatsMutex);
+    auto it = _parallelCommandStats.find(methodLine);
+    if (it == _parallelCommandStats.end() || !it->second.blacklisted) {
+        return false;
+    }
+    _decayConflictRate(methodLine, it->second, STimeNow());
+    return it->second.blacklisted;
+}
+
+list<string> BedrockServer::_getParallelCommandStats() {
+    list<string> result;
+    const uint64_t now = STimeNow();
+    lock_guard<mutex> lock(_parallelCommandStatsMutex);
+    for (auto& [methodLine, stats] : _parallelCommandStats) {
+        _decayConflictRate(methodLine, stats, now);
+        STable values;
+        values["command"] = methodLine;
+        values["commits"] = to_string(stats.commits);
+        values["conflicts"] = to_string(stats.conflicts);
+        values["retriesExhausted"] = to_string(stats.retriesExhausted);
+        values["averageProcessUS"] = to_string(stats.commits ? stats.processUS / stats.commits : 0);
+        values["conflictRate"] = SToStr(stats.conflictRate);
+        values["blacklisted"] = stats.blacklisted ? "true" : "false";
+        result.push_back(SComposeJSONObject(values));
+    }
+    return result;
+}
+
+void BedrockServer::_recordTableAccess(const string& name, const SQLite& db, bool conflicted) {
+    if (!_conflictAwareScheduling) {
+        return;
+    }
+    const set<string>& read = db.getTablesRead();
+    const set<string>& written = db.getTablesWritten();
+    lock_guard<mutex> lock(_tableAccessMutex);
+    auto it = _tableAccess.find(name);
+    if (it == _tableAccess.end()) {
+        if (_tableAccess.size() >= MAX_TABLE_ACCESS_NAMES) {
+            return;
+        }
+        it = _tableAccess.emplace(name, TableAccess{make_shared<const TableSet>(), 0}).first;
+    }
+    TableAccess& access = it->second;
+    access.conflictRate = (access.conflictRate * 15 + (conflicted ? 1 : 0)) / 16;
+
+    // Once a command's tables have been learned, this is almost always a no-op, so only copy the sets when there's
+    // something new in them. Claims holding the old sets keep them.
+    if (!includes(access.tables->read.begin(), access.tables->read.end(), read.begin(), read.end()) ||
+        !includes(access.tables->written.begin(), access.tables->written.end(), written.begin(), written.end())) {
+        auto tables = make_shared<TableSet>(*access.tables);
+        tables->read.insert(read.begin(), read.end());
+        tables->written.insert(written.begin(), written.end());
+        access.tables = move(tables);
+    }
+}
+
+uint64_t BedrockServer::_claimTables(const string& name, bool canDefer, bool& deferred) {
+    if (!_conflictAwareScheduling) {
+        return 0;
+    }
+    lock_guard<mutex> lock(_tableAccessMutex);
+    auto it = _tableAccess.find(name);
+    if (it == _tableAccess.end() || it->second.tables->written.empty()) {
+        return 0;
+    }
+    const shared_ptr<const TableSet>& tables = it->second.tables;
+
+    // Two commands are likely to conflict if either writes a table the other reads or writes.
+    auto overlaps = [](const set<string>& a, const set<string>& b) {
+        for (auto i = a.begin(), j = b.begin(); i != a.end() && j != b.end();) {
+            if (*i < *j) {
+                i++;
+            } else if (*j < *i) {
+                j++;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto conflicting = [&]() {
+        for (const auto& claim : _tableClaims) {
+            if (overlaps(tables->written, claim.second->read) || overlaps(tables->written, claim.second->written) ||
+                overlaps(tables->read, claim.second->written)) {
+                return true;
+            }
+        }
+        return false;
+    };
+    if (canDefer && it->second.conflictRate >= CONFLICT_AWARE_MIN_RATE && conflicting()) {
+        SINFO("Deferring '" << name << "' until commands using the same tables finish.");
+        _conflictWaits++;
+        deferred = true;
+        return 0;
+    }
+    const uint64_t claim = ++_lastTableClaim;
+    _tableClaims.emplace(claim, tables);
+    return claim;
+}
+
+void BedrockServer::_releaseTables(uint64_t claim) {
+    if (!claim) {
+        return;
     }
+    lock_guard<mutex> lock(_tableAccessMutex);
+    _tableClaims.erase(claim);
 }
 
 unique_ptr<BedrockCommand> BedrockServer::getCommandFromPlugins(SData&& request) {
@@ -1724,19 +2288,37 @@ unique_ptr<BedrockCommand> BedrockServer::getCommandFromPlugins(unique_ptr<SQLit
 }
 
 void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
-    SAUTOLOCK(_socketIDMutex);
-
     // Finalize timing info even for commands we won't respond to (this makes this data available in logs).
     command->finalizeTimingInfo();
+    _recordServiceTime(command);
 
     // Don't reply to commands with pseudo-clients (i.e., commands that we generated by other commands).
     if (command->initiatingClientID < 0) {
         return;
     }
 
+    // Hand the command to the thread that owns its socket.
+    if (command->initiatingClientOwner >= _clientSocketOwners.size()) {
+        SWARN("No socket owner #" << command->initiatingClientOwner << " to reply to '" << command->request.methodLine
+              << "'.");
+        command->handleFailedReply();
+        return;
+    }
+    _clientSocketOwners[command->initiatingClientOwner]->replies.push(move(command));
+}
+
+void BedrockServer::_sendReplies(ClientSocketOwner& owner) {
+    unique_ptr<BedrockCommand> command;
+    while (owner.replies.pop(command)) {
+        SAUTOPREFIX(command->request);
+        _sendReply(owner, command);
+    }
+}
+
+void BedrockServer::_sendReply(ClientSocketOwner& owner, unique_ptr<BedrockCommand>& command) {
     // Do we have a socket for this command?
-    auto socketIt = _socketIDMap.find(command->initiatingClientID);
-    if (socketIt != _socketIDMap.end()) {
+    ClientSocketState* state = owner.socketIDMap.find(command->initiatingClientID);
+    if (state) {
         command->response["nodeName"] = args["-nodeName"];
 
         // If we're shutting down, tell the caller to close the connection.
@@ -1744,6 +2326,9 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
             command->response["Connection"] = "close";
         }
 
+        // If `Connection: close` was set, shut down the socket, in case the caller ignores us.
+        bool close = SIEquals(command->request["Connection"], "close") || _shutdownState.load() != RUNNING;
+
         // Is a plugin handling this command? If so, it gets to send the response.
         const string& pluginName = command->request["plugin"];
 
@@ -1753,22 +2338,28 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
                   << "' to request '" << command->request.methodLine << "'");
             auto it = plugins.find(pluginName);
             if (it != plugins.end()) {
-                it->second->onPortRequestComplete(*command, socketIt->second);
+                it->second->onPortRequestComplete(*command, state->socket);
             } else {
                 SERROR("Couldn't find plugin '" << pluginName << ".");
             }
-        } else {
-            // Otherwise we send the standard response.
-            socketIt->second->send(command->response.serialize());
-        }
+            if (close) {
+                shutdownSocket(state->socket, SHUT_RDWR);
+            }
 
-        // If `Connection: close` was set, shut down the socket, in case the caller ignores us.
-        if (SIEquals(command->request["Connection"], "close") || _shutdownState.load() != RUNNING) {
-            shutdownSocket(socketIt->second, SHUT_RDWR);
+            // Plugin sockets only ever have one request outstanding, so there's nothing left pending.
+            owner.socketIDMap.erase(command->initiatingClientID);
+        } else {
+            // Otherwise we send the standard response, once every earlier response on this socket has gone out. The
+            // content can be large, so it's moved into the socket's send queue separately from the headers rather
+            // than being copied into a single serialized string.
+            string headers, content;
+            if (command->initiatingClientBinary) {
+                command->response.serializeBinary(headers, content);
+            } else {
+                command->response.serialize(headers, content);
+            }
+            _sendInOrder(owner, *state, command->initiatingClientSequence, {move(headers), move(content)}, close);
         }
-
-        // We only keep track of sockets with pending commands.
-        _socketIDMap.erase(socketIt);
     } else {
         if (!SIEquals(command->request["Connection"], "forget")) {
             SINFO("No socket to reply for: '" << command->request.methodLine << "' #" << command->initiatingClientID);
@@ -1779,6 +2370,36 @@ void BedrockServer::_reply(unique_ptr<BedrockCommand>& command) {
     }
 }
 
+void BedrockServer::_sendInOrder(ClientSocketOwner& owner, ClientSocketState& state, uint64_t sequence,
+                                 list<string>&& response, bool close) {
+    if (sequence < state.nextReplySequence) {
+        // We've already stopped replying on this socket (because an earlier response closed it).
+        SINFO("Dropping reply #" << sequence << " to socket " << state.socket->id << ", socket already finished.");
+        return;
+    }
+    state.readyReplies.emplace(sequence, make_pair(move(response), close));
+
+    // Send everything that's now in order.
+    auto replyIt = state.readyReplies.begin();
+    while (replyIt != state.readyReplies.end() && replyIt->first == state.nextReplySequence) {
+        state.socket->send(move(replyIt->second.first));
+        state.nextReplySequence++;
+        if (replyIt->second.second) {
+            // Nothing after this goes out.
+            shutdownSocket(state.socket, SHUT_RDWR);
+            state.nextReplySequence = state.nextRequestSequence;
+            state.readyReplies.clear();
+            break;
+        }
+        replyIt = state.readyReplies.erase(replyIt);
+    }
+
+    // We only keep track of sockets with pending commands.
+    if (state.nextReplySequence == state.nextRequestSequence) {
+        owner.socketIDMap.erase(state.socket->id);
+    }
+}
+
 void BedrockServer::suppressCommandPort(const string& reason, bool suppress, bool manualOverride) {
     // If we've set the manual override flag, then we'll only actually make this change if we've specified it again.
     if (_suppressCommandPortManualOverride && !manualOverride) {
@@ -1911,6 +2532,7 @@ void BedrockServer::_status(unique_ptr<BedrockCommand>& command) {
             // Both of these need to be in the correct state for multi-write to be enabled.
             content["multiWriteEnabled"] = _multiWriteEnabled ? "true" : "false";
             content["multiWriteManualBlacklist"] = SComposeJSONArray(_blacklistedParallelCommands);
+            content["multiWriteAutoBlacklist"] = SComposeJSONArray(_getParallelCommandStats());
         }
 
         // Coalesce all of the peer data into one value to return or return
@@ -1929,6 +2551,24 @@ void BedrockServer::_status(unique_ptr<BedrockCommand>& command) {
         });
         content["peerList"]                    = SComposeJSONArray(peerList);
         content["queuedCommandList"]           = SComposeJSONArray(_commandQueue.getRequestMethodLines());
+        content["commandQueueDelayUS"]         = to_string(_commandQueue.standingDelay());
+        content["commandQueueFlows"]           = SComposeJSONArray(_commandQueue.getFlowStats());
+        content["shedCommandCount"]            = to_string(_shedCommandCount.load());
+        content["activeWorkerThreads"]         = to_string(_activeWorkerThreads.load());
+        content["conflictAwareWaits"]          = to_string(_conflictWaits.load());
+        content["groupCommitCount"]            = to_string(SQLite::groupCommitCount.load());
+        content["groupCommitSyncs"]            = to_string(SQLite::groupCommitSyncs.load());
+        content["threadPlacement"]             = SComposeJSONObject(SThreadPlacement::getPlacements());
+        content["singleFlightExecutions"]      = to_string(_singleFlightExecutions.load());
+        content["singleFlightMerged"]          = to_string(_singleFlightMerged.load());
+        {
+            // The share of commands eligible to share a peek that did.
+            uint64_t merged = _singleFlightMerged.load();
+            uint64_t eligible = merged + _singleFlightExecutions.load();
+            content["singleFlightHitRate"] = SToStr(eligible ? (double)merged / eligible : 0.0);
+        }
+        content["tlsSessionCacheHits"]         = to_string(SSSLSessionCache::hits());
+        content["tlsSessionCacheMisses"]       = to_string(SSSLSessionCache::misses());
         content["syncThreadQueuedCommandList"] = SComposeJSONArray(syncNodeQueuedMethods);
 
         auto _syncNodeCopy = atomic_load(&_syncNode);
@@ -2215,8 +2855,101 @@ void BedrockServer::_acceptSockets() {
             // Remember that this socket is owned by this plugin.
             SASSERT(!s->data);
             s->data = plugin;
+        } else if (acceptPort == _commandPort && !_clientIOThreads.empty()) {
+            // Hand command port sockets to whichever client I/O thread currently has the fewest.
+            removeSocket(s);
+            auto least = min_element(_clientIOThreads.begin(), _clientIOThreads.end(),
+                [](const unique_ptr<ClientIOThread>& a, const unique_ptr<ClientIOThread>& b) {
+                    return a->socketCount() < b->socketCount();
+                });
+            (*least)->adopt(s);
+        }
+    }
+}
+
+size_t BedrockServer::_clientSocketCount() {
+    size_t count = socketList.size();
+    for (auto& ioThread : _clientIOThreads) {
+        count += ioThread->socketCount();
+    }
+    return count;
+}
+
+BedrockServer::ClientIOThread::ClientIOThread(BedrockServer& server, int threadId, ClientSocketOwner& owner)
+  : _server(server), _owner(owner), _socketCount(0), _exit(false)
+{
+    _thread = thread(&ClientIOThread::_run, this, threadId);
+}
+
+BedrockServer::ClientIOThread::~ClientIOThread() {
+    _exit.store(true);
+
+    // Push an empty socket to wake up the thread's `poll` loop.
+    _adoptedSockets.push(nullptr);
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+void BedrockServer::ClientIOThread::adopt(Socket* socket) {
+    _socketCount++;
+    _adoptedSockets.push(move(socket));
+}
+
+void BedrockServer::ClientIOThread::_close(Socket* socket) {
+    _owner.socketIDMap.erase(socket->id);
+    closeSocket(socket);
+    _socketCount--;
+}
+
+void BedrockServer::ClientIOThread::_run(int threadId) {
+    SInitialize("clientIO" + to_string(threadId));
+    while (!_exit.load()) {
+        // Nothing else touches our sockets, so none of this needs a lock. Workers hand us their responses through
+        // `_owner.replies`.
+        fd_map fdm;
+        _adoptedSockets.prePoll(fdm);
+        _owner.replies.prePoll(fdm);
+        prePoll(fdm);
+        S_poll(fdm, STIME_US_PER_S);
+        _adoptedSockets.postPoll(fdm);
+        _owner.replies.postPoll(fdm);
+        while (!_adoptedSockets.empty()) {
+            Socket* socket = _adoptedSockets.pop();
+            if (socket) {
+                addSocket(socket);
+            }
+        }
+        postPoll(fdm);
+        _server._sendReplies(_owner);
+
+        // Parse and dispatch requests exactly as the main thread does.
+        size_t before = socketList.size();
+        _server._readClientRequests(*this, _owner);
+        _socketCount -= before - socketList.size();
+
+        // Once the main thread has decided all clients have been responded to (or it's given up waiting), nothing
+        // more can be processed for our remaining sockets.
+        if (_server._shutdownState.load() >= CLIENTS_RESPONDED && socketList.size()) {
+            SINFO("Killing " << socketList.size() << " remaining sockets at shutdown.");
+            while (socketList.size()) {
+                _close(socketList.front());
+            }
         }
     }
+
+    // Clean up anything still open. Any replies still waiting for us go out first, or are reported as failed if their
+    // socket is gone.
+    while (!_adoptedSockets.empty()) {
+        Socket* socket = _adoptedSockets.pop();
+        if (socket) {
+            addSocket(socket);
+        }
+    }
+    _server._sendReplies(_owner);
+    while (socketList.size()) {
+        _close(socketList.front());
+    }
 }
 
 void BedrockServer::waitForHTTPS(unique_ptr<BedrockCommand>&& command) {
@@ -253,23 +253,117 @@ class BedrockServer : public SQLiteServer {
     // These are commands that will be processed in a blacking fashion.
     BedrockCommandQueue _blockingCommandQueue;
 
-    // Each time we read a new request from a client, we give it a unique ID.
-    uint64_t _requestCount;
-
-    // Each time we read a command off a socket, we put the socket in this map, so that we can respond to it when the
-    // command completes. We remove the socket from the map when we reply to the command, even if the socket is still
-    // open. It will be re-inserted in this set when another command is read from it.
-    map <uint64_t, Socket*> _socketIDMap;
-
-    // The above _socketIDMap is modified by multiple threads, so we lock this mutex around operations that access it.
-    // We don't need to lock around access to the base class's `socketList` because we carefully control access to it
-    // to the main thread.
-    // The only functions that access `socketList` are prePoll, postPoll, openSocket, and closeSocket, in STCPManager,
-    // and acceptSocket in STCPServer.
-    // prePoll and postPoll are only ever called by the main thread.
-    // openSocket is never called by bedrockServer (it is called in SHTTPSManager and STCPNode).
-    // closeSocket and acceptSocket are only called inside postPoll.
-    recursive_mutex _socketIDMutex;
+    // Each time we read a new request from a client, we give it a unique ID. This is atomic because client I/O threads
+    // may read requests concurrently with the main thread.
+    atomic<uint64_t> _requestCount;
+
+    // The state of a client socket with commands in progress. Clients can pipeline requests on a single socket, and
+    // those commands may complete in any order, so each request is given the next `nextRequestSequence` as it's read,
+    // and responses are held in `readyReplies` until every earlier response has been sent.
+    struct ClientSocketState {
+        ClientSocketState(Socket* socket_) : socket(socket_) {}
+        Socket* socket;
+        uint64_t nextRequestSequence = 0;
+        uint64_t nextReplySequence = 0;
+
+        // Serialized responses (as a header block and content) waiting on earlier ones, and whether to shut down the
+        // socket after sending each.
+        map<uint64_t, pair<list<string>, bool>> readyReplies;
+    };
+
+    // Client sockets are owned by a single thread, either the main thread or a client I/O thread, which does all
+    // reading and writing on them. Worker threads never touch client sockets directly: when a command completes,
+    // `_reply` pushes it onto the owning thread's `replies` queue, which is lock-free, and the owner sends the
+    // response. This means there's no lock shared between the workers and the network loops.
+    struct ClientSocketOwner {
+        ClientSocketOwner(size_t index_) : index(index_) {}
+
+        // This owner's position in `_clientSocketOwners`. Stored on commands as `initiatingClientOwner`.
+        const size_t index;
+
+        // Each time we read a command off a socket, we put the socket in this map, so that we can respond to it when
+        // the command completes. We remove the socket from the map when we've replied to every command read from it,
+        // even if the socket is still open. It will be re-inserted in this set when another command is read from it.
+        // This is keyed by socket ID, so finding the socket for a reply is constant time. Only the owning thread
+        // accesses this.
+        SSlotMap<ClientSocketState> socketIDMap;
+
+        // Completed commands waiting for the owning thread to send their responses.
+        SMPSCQueue<unique_ptr<BedrockCommand>> replies;
+    };
+
+    // The first of these is the main thread's, and the rest belong to the client I/O threads, in order. This is
+    // populated in the constructor and never changes afterward, so any thread can read it.
+    vector<unique_ptr<ClientSocketOwner>> _clientSocketOwners;
+
+    // Sends the responses for any commands waiting in `owner`'s `replies` queue. Only called by the owning thread.
+    void _sendReplies(ClientSocketOwner& owner);
+
+    // Sends the response for a single completed command.
+    void _sendReply(ClientSocketOwner& owner, unique_ptr<BedrockCommand>& command);
+
+    // The maximum number of requests we'll read from a single socket before we've replied to them. Set by
+    // `-maxPipelinedRequests`. Defaults to 1, which processes each client's requests strictly one at a time.
+    size_t _maxPipelinedRequests;
+
+    // Queues a serialized response to go out as reply number `sequence` on the given socket, and sends every response
+    // that is now in order. Removes the socket from `owner.socketIDMap` once nothing is outstanding on it, which
+    // invalidates `state`.
+    void _sendInOrder(ClientSocketOwner& owner, ClientSocketState& state, uint64_t sequence, list<string>&& response,
+                      bool close);
+
+    // A client I/O thread owns a share of the sockets accepted on the command port. If `-clientIOThreads` is set, the
+    // main thread still accepts connections on all of our ports, but hands command port sockets off to these threads,
+    // which do all reading, parsing and flushing for them. This lets a burst of client traffic be spread across
+    // several threads rather than serializing on the main thread. Sockets accepted on the control port and plugin
+    // ports stay on the main thread.
+    class ClientIOThread : public STCPManager {
+      public:
+        ClientIOThread(BedrockServer& server, int threadId, ClientSocketOwner& owner);
+        ~ClientIOThread();
+
+        // Takes ownership of a socket accepted by the main thread. The socket must already have been removed from the
+        // main thread's manager with `removeSocket`.
+        void adopt(Socket* socket);
+
+        // The number of sockets owned by this thread, including any that have been adopted but not yet picked up.
+        size_t socketCount() const { return _socketCount.load(); }
+
+      private:
+        // Main loop for this thread.
+        void _run(int threadId);
+
+        // Closes a socket, removing it from `_owner.socketIDMap`.
+        void _close(Socket* socket);
+
+        BedrockServer& _server;
+
+        // The state of our sockets that have commands in progress, and the queue of replies for them.
+        ClientSocketOwner& _owner;
+
+        // Sockets handed to us by the main thread. This wakes up our `poll` loop when a new one arrives.
+        SSynchronizedQueue<Socket*> _adoptedSockets;
+        atomic<size_t> _socketCount;
+        atomic<bool> _exit;
+        thread _thread;
+    };
+    vector<unique_ptr<ClientIOThread>> _clientIOThreads;
+
+    // Reads and dispatches any complete requests from the sockets in the given manager, and closes any that are
+    // finished. This is called by the main thread for its own sockets, and by each client I/O thread for its sockets.
+    void _readClientRequests(STCPManager& manager, ClientSocketOwner& owner);
+
+    // Reads and dispatches the next complete request from a single socket, returning true if it did so and there may
+    // be more to read.
+    bool _readClientRequest(ClientSocketOwner& owner, STCPManager::Socket* s, list<STCPManager::Socket*>& socketsToClose,
+                            uint64_t lastChance, int& deserializationAttempts, int& deserializedRequests);
+
+    // Returns the number of client sockets currently open, across the main thread and all client I/O threads.
+    size_t _clientSocketCount();
+
+    // Once we're shutting down, this is a timestamp after which we'll start giving up on any sockets that don't seem
+    // to be giving us any data.
+    atomic<uint64_t> _lastChance;
 
     // This is the replication state of the sync node. It's updated after every SQLiteNode::update() iteration. A
     // reference to this object is passed to the sync thread to allow this update.
@@ -336,8 +430,19 @@ class BedrockServer : public SQLiteServer {
                        BedrockServer& server,
                        int threadId);
 
+    // Runs commands on `db` until the worker should exit, returning false, or be parked, returning true.
+    static bool _runWorker(SQLite& db,
+                           atomic<SQLiteNode::State>& _replicationState,
+                           atomic<string>& leaderVersion,
+                           BedrockTimeoutCommandQueue& syncNodeQueuedCommands,
+                           BedrockTimeoutCommandQueue& syncNodeCompletedCommands,
+                           BedrockServer& server,
+                           int threadId);
+
     // Send a reply for a completed command back to the initiating client. If the `originator` of the command is set,
-    // then this is an error, as the command should have been sent back to a peer.
+    // then this is an error, as the command should have been sent back to a peer. This can be called from any thread:
+    // it takes ownership of `command` and passes it to the thread that owns the client's socket, which sends the
+    // response. `command` is empty after this returns, unless it's for a pseudo-client that gets no reply.
     void _reply(unique_ptr<BedrockCommand>& command);
 
     // The following are constants used as methodlines by status command requests.
@@ -387,6 +492,49 @@ class BedrockServer : public SQLiteServer {
     static set<string> _blacklistedParallelCommands;
     static shared_timed_mutex _blacklistedParallelCommandMutex;
 
+    // The automatic blacklist. We keep statistics on worker commits for each command (by method line), and once a
+    // command's conflict rate reaches `_autoBlacklistConflictRate` (`-autoBlacklistConflictRate`, off by default),
+    // it's sent to the blocking commit thread after peek instead of being processed in parallel. Its conflict rate
+    // decays with time while it's there, and once it's fallen below half the threshold, it's tried in parallel again.
+    struct ParallelCommandStats {
+        // Worker commits attempted, how many of them conflicted, and how many times the command ran out of retries
+        // and had to go to the blocking queue.
+        uint64_t commits;
+        uint64_t conflicts;
+        uint64_t retriesExhausted;
+
+        // Total time spent in process and commit, including attempts that conflicted.
+        uint64_t processUS;
+
+        // The share of recent commits that conflicted, as of `updated`.
+        double conflictRate;
+        uint64_t updated;
+        bool blacklisted;
+    };
+    double _autoBlacklistConflictRate;
+    mutex _parallelCommandStatsMutex;
+    map<string, ParallelCommandStats> _parallelCommandStats;
+
+    static const size_t MAX_PARALLEL_COMMAND_STATS = 1000;
+    static constexpr uint64_t AUTO_BLACKLIST_MIN_COMMITS = 16;
+    static constexpr uint64_t AUTO_BLACKLIST_HALF_LIFE_US = 10'000'000;
+
+    // Records a worker commit of `command` that took `processUS` to process and commit.
+    void _recordParallelCommit(const string& methodLine, bool conflicted, uint64_t processUS);
+
+    // Records that `command` ran out of retries on a worker.
+    void _recordRetriesExhausted(const string& methodLine);
+
+    // Returns true if `command` is automatically blacklisted at the moment.
+    bool _isAutoBlacklisted(const string& methodLine);
+
+    // Returns the statistics for every command, as JSON objects, for `Status`.
+    list<string> _getParallelCommandStats();
+
+    // Brings `stats.conflictRate` up to `now`, and takes the command off the blacklist if it's decayed far enough.
+    // Call with `_parallelCommandStatsMutex` locked.
+    void _decayConflictRate(const string& methodLine, ParallelCommandStats& stats, uint64_t now);
+
     // Stopwatch to track if we're going to give up on gracefully shutting down and force it.
     SStopwatch _gracefulShutdownTimeout;
 
@@ -461,6 +609,11 @@ class BedrockServer : public SQLiteServer {
     // and responded to upon return
     bool _handleIfStatusOrControlCommand(unique_ptr<BedrockCommand>& command);
 
+    // Status and control commands read by client I/O threads, waiting for the main thread to run them. Control
+    // commands change state that only the main thread can touch (like our ports), so they can't run on the thread that
+    // read them. Status commands come along so they stay in order with them. Replies go back through `_reply` as usual.
+    SSynchronizedQueue<unique_ptr<BedrockCommand>> _mainThreadCommands;
+
     // Check a command against the list of crash commands, and return whether we think the command would crash.
     bool _wouldCrash(const unique_ptr<BedrockCommand>& command);
 
@@ -480,6 +633,146 @@ class BedrockServer : public SQLiteServer {
     // Whether or not all plugins are detached
     bool _pluginsDetached;
 
+    // Admission control. If commands have been waiting in `_commandQueue` for longer than `_admissionTargetUS` (set by
+    // `-admissionTargetMS`, and disabled if 0), new client commands are answered immediately with a 503 rather than
+    // queued behind them. The further past the target the queue is, the higher the priorities that get turned away,
+    // and PRIORITY_MAX commands are always queued.
+    uint64_t _admissionTargetUS;
+    atomic<uint64_t> _shedCommandCount;
+
+    // Returns true if `command` should be turned away rather than queued.
+    bool _shouldShed(const unique_ptr<BedrockCommand>& command);
+
+    // Deadline scheduling (`-deadlineScheduling`). Commands in `_commandQueue` are taken in order of their timeouts
+    // within each priority, and a worker turns away any command that it couldn't finish before its timeout, going by
+    // how long recent commands of the same name took, rather than peeking it. These count as shed commands.
+    bool _deadlineScheduling;
+
+    // How long commands take from being dequeued by a worker to being answered, by command name, smoothed over recent
+    // commands, along with when we last heard how long one took. Names past the first `MAX_SERVICE_TIME_NAMES` aren't
+    // tracked.
+    struct ServiceTime {
+        uint64_t estimateUS;
+        uint64_t updated;
+    };
+    static const size_t MAX_SERVICE_TIME_NAMES = 1000;
+    mutex _serviceTimeMutex;
+    map<string, ServiceTime> _serviceTimes;
+
+    // Commands that are turned away never tell us how long they'd have taken, so once a name's estimate is past its
+    // timeout, we'd never run another. So if we haven't heard about a name for this long, we let one through anyway.
+    static constexpr uint64_t SERVICE_TIME_PROBE_US = 1'000'000;
+
+    // Records how long `command` took, once it's been answered.
+    void _recordServiceTime(const unique_ptr<BedrockCommand>& command);
+
+    // Returns true if `command`, which hasn't been peeked yet, can't be finished before its timeout.
+    bool _cannotFinishInTime(const unique_ptr<BedrockCommand>& command);
+
+    // Single-flight reads (`-singleFlightReads`). When a worker is about to peek a client command, and an identical
+    // command (see `_singleFlightKey`) is already being peeked by another worker at the same commit count, it waits
+    // for that one instead. If the peek completes the command, every waiter gets a copy of its response. If not, the
+    // command wasn't a read, and the waiters are queued again to run on their own.
+    bool _singleFlightReads;
+    mutex _singleFlightMutex;
+    map<string, list<unique_ptr<BedrockCommand>>> _singleFlights;
+    atomic<uint64_t> _singleFlightExecutions;
+    atomic<uint64_t> _singleFlightMerged;
+
+    // Returns the key identifying commands that would get the same answer from `peek` at `commitCount`, or an empty
+    // string if `command` can't share a peek.
+    string _singleFlightKey(const unique_ptr<BedrockCommand>& command, uint64_t commitCount);
+
+    // If a command with the same key is in flight, takes `command` to wait for it, and returns true. Otherwise, marks
+    // `command` as in flight, and returns false, in which case `_finishSingleFlight` must be called after its peek.
+    bool _joinSingleFlight(const string& key, unique_ptr<BedrockCommand>& command);
+
+    // Answers everything waiting on `key` with `response`, or if that's null, queues them again.
+    void _finishSingleFlight(const string& key, const SData* response);
+
+    // Conflict-aware scheduling (`-conflictAwareScheduling`). Workers learn which tables each command reads and
+    // writes, as seen by the SQLite authorizer, and how often its worker commits conflict. A worker about to start a
+    // command that could be written in parallel claims the tables it's expected to use. If that command conflicts
+    // often, and a running command has claimed a table that one of them writes and the other uses, the worker puts it
+    // back in the queue for `CONFLICT_WAIT_US` rather than racing that command to a conflict, and moves on to other
+    // work. A command is only put back once.
+    // The learned tables are shared, never modified in place, between `_tableAccess` and the claims made from it, so
+    // claiming them doesn't copy them. Learning a new table replaces the whole set.
+    struct TableSet {
+        set<string> read;
+        set<string> written;
+    };
+    struct TableAccess {
+        shared_ptr<const TableSet> tables;
+
+        // Share of recent commits that conflicted, smoothed over about the last 16.
+        double conflictRate;
+    };
+    bool _conflictAwareScheduling;
+    mutex _tableAccessMutex;
+
+    // Keyed by `methodLine`, the same as `_parallelCommandStats`.
+    map<string, TableAccess> _tableAccess;
+    map<uint64_t, shared_ptr<const TableSet>> _tableClaims;
+    uint64_t _lastTableClaim;
+    atomic<uint64_t> _conflictWaits;
+
+    static const size_t MAX_TABLE_ACCESS_NAMES = 1000;
+    static constexpr uint64_t CONFLICT_WAIT_US = 50'000;
+    static constexpr double CONFLICT_AWARE_MIN_RATE = 0.05;
+
+    // Records the tables that the last transaction on `db`, for a command with the method line `name`, used, and whether its commit
+    // conflicted.
+    void _recordTableAccess(const string& name, const SQLite& db, bool conflicted);
+
+    // Claims the tables that commands with the method line `name` are expected to use. Returns an ID to pass to
+    // `_releaseTables`, or 0 if nothing was claimed. If `canDefer` is set, they conflict often, and there are
+    // conflicting claims, claims nothing and sets `deferred` instead.
+    uint64_t _claimTables(const string& name, bool canDefer, bool& deferred);
+    void _releaseTables(uint64_t claim);
+
+    // Releases a claim from `_claimTables` when it goes out of scope.
+    struct TableClaim {
+        TableClaim(BedrockServer& server_, uint64_t id_) : server(server_), id(id_) {}
+        ~TableClaim() { server._releaseTables(id); }
+        BedrockServer& server;
+        const uint64_t id;
+    };
+
+    // Adaptive worker pool (`-minWorkerThreads` and `-maxWorkerThreads`). The sync thread starts the maximum number of
+    // workers, but only those with thread IDs below `_activeWorkerThreads` take commands. The rest are parked, having
+    // given their DB handles back to the pool, until they're needed. Once a second, the sync thread adjusts how many
+    // are active: fewer if worker commits are conflicting, more if commands are waiting in the queue and there's CPU
+    // to spare, and fewer again once the queue's keeping up.
+    int _minWorkerThreads;
+    int _maxWorkerThreads;
+    atomic<int> _activeWorkerThreads;
+    mutex _parkedWorkerMutex;
+    condition_variable _parkedWorkerCV;
+
+    // Commits attempted on worker threads, and how many of those conflicted.
+    atomic<uint64_t> _workerCommits;
+    atomic<uint64_t> _workerConflicts;
+
+    // What the controller saw last time it ran.
+    struct WorkerPoolSample {
+        uint64_t time;
+        uint64_t cpuUS;
+        uint64_t commits;
+        uint64_t conflicts;
+    };
+
+    static constexpr uint64_t WORKER_ADJUSTMENT_INTERVAL_US = 1'000'000;
+    static constexpr uint64_t WORKER_QUEUE_TARGET_US = 5'000;
+    static constexpr double WORKER_MAX_CONFLICT_RATE = 0.1;
+    static constexpr double WORKER_MAX_CPU_UTILIZATION = 0.9;
+
+    // Called by the sync thread to grow or shrink the active worker set, if it's time to.
+    void _adjustWorkerThreads(WorkerPoolSample& last);
+
+    // Called by a parked worker. Returns true when it's active again, or false if the server is shutting down.
+    bool _waitWhileParked(int threadId);
+
     // This is a snapshot of the state of the node taken at the beginning of any call to peekCommand or processCommand
     // so that the state can't change for the lifetime of that call, from the view of that function.
     static thread_local atomic<SQLiteNode::State> _nodeStateSnapshot;
@@ -0,0 +1,182 @@
+#include <libstuff/libstuff.h>
+#include "SDNSResolver.h"
+
+#include <arpa/nameser.h>
+#include <netdb.h>
+#include <resolv.h>
+#include <sys/eventfd.h>
+
+atomic<uint64_t> SDNSResolver::cacheHits(0);
+atomic<uint64_t> SDNSResolver::cacheMisses(0);
+
+SDNSResolver::Lookup::Lookup(const string& domain_, bool finished, in_addr_t ip)
+  : domain(domain_), _done(finished), _ip(ip), _fd(finished ? -1 : eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    SASSERT(finished || _fd >= 0);
+}
+
+SDNSResolver::Lookup::~Lookup() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+in_addr_t SDNSResolver::Lookup::wait() {
+    unique_lock<mutex> lock(_waitMutex);
+    _waitCV.wait(lock, [this]() { return _done.load(); });
+    return _ip;
+}
+
+void SDNSResolver::Lookup::_finish(in_addr_t ip) {
+    {
+        lock_guard<mutex> lock(_waitMutex);
+        _ip = ip;
+        _done.store(true);
+    }
+    _waitCV.notify_all();
+
+    // We never read this back, so it stays readable for anyone polling it.
+    uint64_t one = 1;
+    if (write(_fd, &one, sizeof(one)) != sizeof(one)) {
+        SWARN("Couldn't signal DNS lookup for '" << domain << "': '" << strerror(errno) << "' (#" << errno << ").");
+    }
+}
+
+SDNSResolver::State& SDNSResolver::_state() {
+    static State* state = new State();
+    return *state;
+}
+
+shared_ptr<SDNSResolver::Lookup> SDNSResolver::resolve(const string& domain) {
+    // Raw IPs don't need resolving.
+    in_addr ip;
+    if (inet_pton(AF_INET, domain.c_str(), &ip) == 1) {
+        return make_shared<Lookup>(domain, true, ip.s_addr);
+    }
+
+    State& state = _state();
+    lock_guard<mutex> lock(state.stateMutex);
+    auto cached = state.cache.find(domain);
+    if (cached != state.cache.end()) {
+        if (STimeNow() < cached->second.expires) {
+            cacheHits++;
+            return make_shared<Lookup>(domain, true, cached->second.ip);
+        }
+        state.cache.erase(cached);
+    }
+    cacheMisses++;
+
+    // If someone's already looking this up, wait for the same answer.
+    auto inFlight = state.inFlight.find(domain);
+    if (inFlight != state.inFlight.end()) {
+        return inFlight->second;
+    }
+
+    if (!state.started) {
+        for (size_t i = 0; i < THREAD_COUNT; i++) {
+            thread(_worker).detach();
+        }
+        state.started = true;
+    }
+    auto lookup = make_shared<Lookup>(domain);
+    state.inFlight.emplace(domain, lookup);
+    state.queue.push_back(lookup);
+    state.queueCV.notify_one();
+    return lookup;
+}
+
+void SDNSResolver::clearCache() {
+    State& state = _state();
+    lock_guard<mutex> lock(state.stateMutex);
+    state.cache.clear();
+}
+
+void SDNSResolver::_worker() {
+    SInitialize("dns");
+    State& state = _state();
+    while (true) {
+        shared_ptr<Lookup> lookup;
+        {
+            unique_lock<mutex> lock(state.stateMutex);
+            state.queueCV.wait(lock, [&state]() { return !state.queue.empty(); });
+            lookup = move(state.queue.front());
+            state.queue.pop_front();
+        }
+
+        uint64_t start = STimeNow();
+        uint64_t ttlUS = 0;
+        in_addr_t ip = _query(lookup->domain, ttlUS);
+        SINFO("DNS lookup took " << (STimeNow() - start) / 1000 << "ms for '" << lookup->domain << "'.");
+
+        {
+            // Failures aren't cached, so the next attempt to connect tries again.
+            lock_guard<mutex> lock(state.stateMutex);
+            state.inFlight.erase(lookup->domain);
+            if (ip != INADDR_NONE) {
+                if (state.cache.size() >= MAX_CACHED_NAMES) {
+                    const uint64_t now = STimeNow();
+                    for (auto it = state.cache.begin(); it != state.cache.end();) {
+                        it = now >= it->second.expires ? state.cache.erase(it) : next(it);
+                    }
+                    if (state.cache.size() >= MAX_CACHED_NAMES) {
+                        state.cache.erase(state.cache.begin());
+                    }
+                }
+                state.cache[lookup->domain] = {ip, STimeNow() + ttlUS};
+            }
+        }
+        lookup->_finish(ip);
+    }
+}
+
+in_addr_t SDNSResolver::_query(const string& domain, uint64_t& ttlUS) {
+    // Ask DNS directly, so we get the address and how long it's good for from the same answer. The answer's good for as
+    // long as its shortest-lived record, which includes any CNAMEs on the way to the address.
+    thread_local struct __res_state resolverState;
+    thread_local bool resolverInitialized = !res_ninit(&resolverState);
+    in_addr_t ip = INADDR_NONE;
+    if (resolverInitialized) {
+        unsigned char answer[4096];
+        int length = res_nquery(&resolverState, domain.c_str(), ns_c_in, ns_t_a, answer, sizeof(answer));
+        ns_msg message;
+        if (length > 0 && !ns_initparse(answer, length, &message)) {
+            uint64_t ttl = UINT64_MAX;
+            for (int i = 0; i < ns_msg_count(message, ns_s_an); i++) {
+                ns_rr record;
+                if (ns_parserr(&message, ns_s_an, i, &record)) {
+                    continue;
+                }
+                ttl = min(ttl, (uint64_t)ns_rr_ttl(record));
+                if (ip == INADDR_NONE && ns_rr_type(record) == ns_t_a && ns_rr_rdlen(record) == sizeof(ip)) {
+                    memcpy(&ip, ns_rr_rdata(record), sizeof(ip));
+                }
+            }
+            if (ip != INADDR_NONE) {
+                ttlUS = min(max(ttl * 1'000'000, MIN_TTL_US), MAX_TTL_US);
+            }
+        }
+    }
+
+    // If DNS didn't have it, it may still come from /etc/hosts or another source in nsswitch.conf, which only the
+    // system resolver knows about, and which don't tell us how long the answer is good for.
+    if (ip == INADDR_NONE) {
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof hints);
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* resolved = nullptr;
+        int result = getaddrinfo(domain.c_str(), nullptr, &hints, &resolved);
+        if (result || !resolved) {
+            SWARN("Can't resolve '" << domain << "': " << gai_strerror(result));
+            freeaddrinfo(resolved);
+            return INADDR_NONE;
+        }
+        ip = ((sockaddr_in*)resolved->ai_addr)->sin_addr.s_addr;
+        freeaddrinfo(resolved);
+        ttlUS = DEFAULT_TTL_US;
+    }
+    char plainTextIP[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &ip, plainTextIP, INET_ADDRSTRLEN);
+    SINFO("Resolved " << domain << " to ip: " << plainTextIP << ".");
+    return ip;
+}
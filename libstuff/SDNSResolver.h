@@ -0,0 +1,92 @@
+#pragma once
+
+// SDNSResolver looks up hostnames on a small pool of background threads, so that opening an outgoing socket never
+// blocks the calling thread on DNS. Answers are cached for as long as their DNS records say they're good for, and
+// concurrent lookups of the same name share a single query.
+//
+// Like our other asynchronous primitives, a lookup can be watched by a `poll` loop: its `fd` becomes readable when it
+// finishes.
+class SDNSResolver {
+  public:
+    class Lookup {
+      public:
+        // A lookup that's already finished doesn't need a descriptor to watch.
+        Lookup(const string& domain_, bool finished = false, in_addr_t ip = INADDR_NONE);
+        ~Lookup();
+
+        Lookup(const Lookup& other) = delete;
+
+        const string domain;
+
+        // True once the lookup has finished, after which `ip` is the resolved address in network byte order, or
+        // INADDR_NONE if the name couldn't be resolved.
+        bool done() const { return _done.load(); }
+        in_addr_t ip() const { return _ip; }
+
+        // A descriptor that's readable once the lookup is done, for `prePoll`. -1 if it was done from the start.
+        int fd() const { return _fd; }
+
+        // Blocks until the lookup is done and returns `ip`.
+        in_addr_t wait();
+
+      private:
+        friend class SDNSResolver;
+        void _finish(in_addr_t ip);
+
+        atomic<bool> _done;
+        in_addr_t _ip;
+        int _fd;
+        mutex _waitMutex;
+        condition_variable _waitCV;
+    };
+
+    // Returns a lookup for `domain`. Raw IP addresses and cached names are returned already done; otherwise, the name
+    // is queued for a resolver thread, or joins a lookup of the same name that's already in progress.
+    static shared_ptr<Lookup> resolve(const string& domain);
+
+    // Waits for the answer to `resolve`, for callers that can't continue without it.
+    static in_addr_t resolveNow(const string& domain) { return resolve(domain)->wait(); }
+
+    // Removes everything from the cache.
+    static void clearCache();
+
+    // How many lookups were answered from the cache, and how many needed a query.
+    static atomic<uint64_t> cacheHits;
+    static atomic<uint64_t> cacheMisses;
+
+    // The number of resolver threads, started with the first lookup that needs one.
+    static constexpr size_t THREAD_COUNT = 4;
+
+    // Answers are cached for their record's TTL, kept within these bounds. Names that don't come from DNS (e.g., from
+    // /etc/hosts) are cached for the default.
+    static constexpr uint64_t MIN_TTL_US = 1'000'000;
+    static constexpr uint64_t MAX_TTL_US = 3600'000'000;
+    static constexpr uint64_t DEFAULT_TTL_US = 60'000'000;
+
+    // The most names we cache at once.
+    static constexpr size_t MAX_CACHED_NAMES = 10'000;
+
+  private:
+    struct CacheEntry {
+        in_addr_t ip;
+        uint64_t expires;
+    };
+
+    // All of our shared state. This is allocated once and never freed, so that resolver threads that are still
+    // waiting for work at exit never see it destroyed.
+    struct State {
+        mutex stateMutex;
+        condition_variable queueCV;
+        list<shared_ptr<Lookup>> queue;
+        map<string, shared_ptr<Lookup>> inFlight;
+        map<string, CacheEntry> cache;
+        bool started = false;
+    };
+    static State& _state();
+
+    static void _worker();
+
+    // Resolves `domain` with a single DNS query, or the system resolver if DNS doesn't know it, setting `ttlUS` to how
+    // long the answer can be cached. Returns INADDR_NONE on failure.
+    static in_addr_t _query(const string& domain, uint64_t& ttlUS);
+};
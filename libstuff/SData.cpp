@@ -92,6 +92,12 @@ string SData::serialize() const {
     return SComposeHTTP(methodLine, nameValueMap, content);
 }
 
+void SData::serialize(string& headers, string& body) {
+    body = move(content);
+    content.clear();
+    SComposeHTTPHeaders(headers, methodLine, nameValueMap, body);
+}
+
 int SData::deserialize(const string& fromString) {
     return (SParseHTTP(fromString, methodLine, nameValueMap, content));
 }
@@ -100,6 +106,137 @@ int SData::deserialize(const char* buffer, size_t length) {
     return (SParseHTTP(buffer, length, methodLine, nameValueMap, content));
 }
 
+int SData::deserialize(const SFastBuffer& buf, SHTTPParser& parser) {
+    return parser.parse(buf.c_str(), buf.size(), methodLine, nameValueMap, content);
+}
+
+// Helpers for reading and writing the big-endian integers in a binary frame.
+static void _appendBinaryInt(string& out, uint64_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        out += (char)((value >> shift) & 0xFF);
+    }
+}
+
+static bool _readBinaryInt(const char*& pos, const char* end, int bytes, uint64_t& value) {
+    if (end - pos < bytes) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < bytes; i++) {
+        value = (value << 8) | (unsigned char)*pos++;
+    }
+    return true;
+}
+
+static bool _readBinaryString(const char*& pos, const char* end, int lengthBytes, string& value) {
+    uint64_t length;
+    if (!_readBinaryInt(pos, end, lengthBytes, length) || (uint64_t)(end - pos) < length) {
+        return false;
+    }
+    value.assign(pos, length);
+    pos += length;
+    return true;
+}
+
+static void _composeBinaryHeaders(string& out, const string& methodLine, const STable& nameValueMap,
+                                  size_t contentLength) {
+    // Everything after the length prefix.
+    size_t frameLength = 4 + methodLine.size() + 4 + 4 + contentLength;
+    for (const auto& field : nameValueMap) {
+        frameLength += 1 + 2 + field.first.size() + 4 + field.second.size();
+    }
+
+    out.clear();
+    out.reserve(1 + 4 + frameLength - contentLength);
+    out += (char)SData::BINARY_MAGIC;
+    _appendBinaryInt(out, frameLength, 4);
+    _appendBinaryInt(out, methodLine.size(), 4);
+    out += methodLine;
+    _appendBinaryInt(out, nameValueMap.size(), 4);
+    for (const auto& field : nameValueMap) {
+        out += (char)SData::BINARY_STRING;
+        _appendBinaryInt(out, field.first.size(), 2);
+        out += field.first;
+        _appendBinaryInt(out, field.second.size(), 4);
+        out += field.second;
+    }
+    _appendBinaryInt(out, contentLength, 4);
+}
+
+int SData::deserializeBinary(const char* buffer, size_t length) {
+    clear();
+
+    // Wait for the whole frame.
+    const char* pos = buffer;
+    const char* end = buffer + length;
+    uint64_t frameLength;
+    if (!isBinary(buffer, length)) {
+        return -1;
+    }
+    pos++;
+    if (!_readBinaryInt(pos, end, 4, frameLength)) {
+        return 0;
+    }
+    if (frameLength > (uint64_t)INT_MAX - 5) {
+        SWARN("Binary frame of " << frameLength << " bytes is too large.");
+        return -1;
+    }
+    if ((uint64_t)(end - pos) < frameLength) {
+        return 0;
+    }
+    end = pos + frameLength;
+
+    // Now everything has to fit inside the frame.
+    uint64_t fieldCount;
+    if (!_readBinaryString(pos, end, 4, methodLine) || !_readBinaryInt(pos, end, 4, fieldCount)) {
+        clear();
+        return -1;
+    }
+    string name;
+    for (uint64_t i = 0; i < fieldCount; i++) {
+        uint64_t type;
+        if (!_readBinaryInt(pos, end, 1, type) || !_readBinaryString(pos, end, 2, name)) {
+            clear();
+            return -1;
+        }
+        if (type == BINARY_STRING) {
+            if (!_readBinaryString(pos, end, 4, nameValueMap[name])) {
+                clear();
+                return -1;
+            }
+        } else if (type == BINARY_INT64) {
+            uint64_t value;
+            if (!_readBinaryInt(pos, end, 8, value)) {
+                clear();
+                return -1;
+            }
+            nameValueMap[name] = to_string((int64_t)value);
+        } else {
+            SWARN("Unknown binary field type " << type << " for '" << name << "'.");
+            clear();
+            return -1;
+        }
+    }
+    if (!_readBinaryString(pos, end, 4, content) || pos != end) {
+        clear();
+        return -1;
+    }
+    return (int)(end - buffer);
+}
+
+string SData::serializeBinary() const {
+    string frame;
+    _composeBinaryHeaders(frame, methodLine, nameValueMap, content.size());
+    frame += content;
+    return frame;
+}
+
+void SData::serializeBinary(string& headers, string& body) {
+    body = move(content);
+    content.clear();
+    _composeBinaryHeaders(headers, methodLine, nameValueMap, body.size());
+}
+
 SData SData::create(const string& fromString) {
     SData data;
     int header = data.deserialize(fromString);
@@ -1,5 +1,7 @@
 #pragma once
 
+class SHTTPParser;
+
 // --------------------------------------------------------------------------
 // A very simple HTTP-like structure consisting of a method line, a table,
 // and a content body.
@@ -88,6 +90,10 @@ struct SData {
     // Serializes this to a string
     string serialize() const;
 
+    // Serializes this into a header block and a separate body, moving our content into `body` rather than copying it,
+    // so it can be sent without another copy. This leaves our content empty.
+    void serialize(string& headers, string& body);
+
     // Deserializes from a string
     int deserialize(const string& rhs);
 
@@ -99,6 +105,42 @@ struct SData {
         return deserialize(buf.c_str(), buf.size());
     }
 
+    // Deserializes from an SFastBuffer that's being filled incrementally, continuing from wherever `parser` stopped
+    // on the previous call for the same buffer.
+    int deserialize(const SFastBuffer& buf, SHTTPParser& parser);
+
+    // Binary framing
+    // As an alternative to the HTTP-like text format, an SData can be sent as a length-prefixed binary frame. This can
+    // be parsed without scanning for line endings or unescaping values, and lets clients send integer values without
+    // formatting them as text. All integers in a frame are big-endian. A frame is:
+    //   1 byte:  BINARY_MAGIC
+    //   4 bytes: length of the rest of the frame
+    //   4 bytes: method line length, followed by the method line
+    //   4 bytes: number of fields, followed by each field:
+    //            1 byte:  BINARY_STRING or BINARY_INT64
+    //            2 bytes: name length, followed by the name
+    //            For BINARY_STRING, 4 bytes of value length followed by the value, for BINARY_INT64, 8 bytes.
+    //   4 bytes: content length, followed by the content
+    // Integer fields are stored in `nameValueMap` as decimal strings, so everything that reads an SData works the same
+    // regardless of which format it arrived in.
+    static const unsigned char BINARY_MAGIC = 0xBD;
+    enum BinaryFieldType : uint8_t { BINARY_STRING = 0, BINARY_INT64 = 1 };
+
+    // Returns true if `buffer` starts with a binary frame rather than a text message. No text message starts with
+    // BINARY_MAGIC, so this only needs the first byte.
+    static bool isBinary(const char* buffer, size_t length) {
+        return length && (unsigned char)buffer[0] == BINARY_MAGIC;
+    }
+
+    // Deserializes a binary frame. Returns the length of the frame, 0 if it's not complete yet, or -1 if it's
+    // malformed, in which case the rest of the buffer can't be parsed either.
+    int deserializeBinary(const char* buffer, size_t length);
+
+    // Serializes to a binary frame, with every field sent as a string. The two-argument version splits the frame
+    // into everything before the content and the content itself, moving our content into `body`, like `serialize`.
+    string serializeBinary() const;
+    void serializeBinary(string& headers, string& body);
+
     // Initializes a new SData from a string. If there is no content provided,
     // then use whatever data remains in the string as the content
     // **DEPRECATED** Use the constructor that handles this instead.
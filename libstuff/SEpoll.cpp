@@ -0,0 +1,55 @@
+#include <libstuff/libstuff.h>
+#include "SEpoll.h"
+
+atomic<bool> SEpoll::enabled(true);
+
+SEpoll::SEpoll() : _epollFD(enabled.load() ? epoll_create1(EPOLL_CLOEXEC) : -1), _events(64) {
+    if (enabled.load() && _epollFD < 0) {
+        SWARN("epoll_create1 failed with response '" << strerror(errno) << "' (#" << errno << "), will use poll.");
+    }
+}
+
+SEpoll::~SEpoll() {
+    if (_epollFD >= 0) {
+        ::close(_epollFD);
+    }
+}
+
+bool SEpoll::set(int fd, short events) {
+    // The poll and epoll event bits have the same values on linux, and POLLHUP/POLLERR are always reported by both.
+    struct epoll_event event = {};
+    event.events = (uint32_t)events & (EPOLLIN | EPOLLPRI | EPOLLOUT);
+    event.data.fd = fd;
+    if (!epoll_ctl(_epollFD, EPOLL_CTL_MOD, fd, &event)) {
+        return true;
+    }
+    return errno == ENOENT && !epoll_ctl(_epollFD, EPOLL_CTL_ADD, fd, &event);
+}
+
+void SEpoll::remove(int fd) {
+    // Errors here just mean the descriptor is already gone, which is what we wanted.
+    epoll_ctl(_epollFD, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+int SEpoll::wait(fd_map& fdm, uint64_t timeoutUS) {
+    int count = epoll_wait(_epollFD, _events.data(), _events.size(), int(timeoutUS / 1000));
+    if (count < 0) {
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        const int fd = _events[i].data.fd;
+        const short revents = (short)(_events[i].events & (EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLERR | EPOLLHUP));
+        auto it = fdm.find(fd);
+        if (it == fdm.end()) {
+            fdm.emplace(fd, (pollfd){fd, 0, revents});
+        } else {
+            it->second.revents |= revents;
+        }
+    }
+
+    // Anything that didn't fit stays ready for next time, but we'll make room for more.
+    if ((size_t)count == _events.size()) {
+        _events.resize(_events.size() * 2);
+    }
+    return count;
+}
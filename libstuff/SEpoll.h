@@ -0,0 +1,47 @@
+#pragma once
+#include <libstuff/libstuff.h>
+
+// SEpoll is a level-triggered epoll set that descriptors stay registered with until they're removed. Each STCPManager
+// keeps one for its sockets, registering each socket when it's opened or accepted, changing its events when it starts
+// or stops having something to send, and removing it when it's closed, so nothing is done for a socket that's idle.
+//
+// An epoll descriptor is itself readable whenever anything registered with it is ready, so a manager puts just that
+// one descriptor in the `fd_map` it's given in `prePoll`, in place of all its sockets. Once `S_poll` reports it ready,
+// `wait` returns only the sockets that are, by adding them to the `fd_map`, so `postPoll` finds them the same way it
+// would have if they'd all been polled.
+class SEpoll {
+  public:
+    // If `enabled` is false, this doesn't create an epoll descriptor at all, and isn't `valid`.
+    SEpoll();
+    ~SEpoll();
+    SEpoll(const SEpoll&) = delete;
+    SEpoll& operator=(const SEpoll&) = delete;
+
+    // Returns false if we have no epoll descriptor, in which case callers should poll their descriptors themselves.
+    bool valid() const { return _epollFD >= 0; }
+
+    // The epoll descriptor, which is readable when any registered descriptor is ready.
+    int fd() const { return _epollFD; }
+
+    // Registers `fd` for `events`, or changes what it's registered for if it already is. Returns false if the kernel
+    // refused it.
+    bool set(int fd, short events);
+
+    // Removes `fd`. Call this before closing a registered descriptor.
+    void remove(int fd);
+
+    // Waits up to `timeoutUS` microseconds for any registered descriptor to be ready, then adds an entry to `fdm` with
+    // `revents` set, exactly as `poll` would, for each one that is. Returns the number of ready descriptors, or -1 on
+    // error.
+    int wait(fd_map& fdm, uint64_t timeoutUS);
+
+    // Set to false to make managers put all of their sockets in the `fd_map` given to `S_poll` instead.
+    static atomic<bool> enabled;
+
+  private:
+    // The epoll instance.
+    int _epollFD;
+
+    // Scratch space for `epoll_wait` so we don't allocate on every call. It grows whenever it's filled.
+    vector<struct epoll_event> _events;
+};
@@ -1,57 +1,214 @@
 #include <libstuff/libstuff.h>
 
-SFastBuffer::SFastBuffer() : front(0) {
+// Each chunk's data follows its header in the same allocation.
+struct SFastBuffer::Chunk {
+    Chunk* next;
+    size_t capacity;
+    size_t front;
+    size_t back;
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    size_t size() const { return back - front; }
+};
+
+// The free chunks kept by one thread. Only chunks of exactly CHUNK_SIZE are kept, and at most MAX_POOLED_CHUNKS of
+// them, anything else goes back to the heap. A chunk can be acquired on one thread and released on another, in which
+// case it just moves to the other thread's list.
+class SFastBufferPool {
+  public:
+    ~SFastBufferPool() {
+        while (_free) {
+            SFastBuffer::Chunk* chunk = _free;
+            _free = chunk->next;
+            ::free(chunk);
+        }
+        _count = 0;
+        _destroyed = true;
+    }
+
+    SFastBuffer::Chunk* acquire(size_t capacity) {
+        SFastBuffer::Chunk* chunk;
+        if (capacity == SFastBuffer::CHUNK_SIZE && _free) {
+            chunk = _free;
+            _free = chunk->next;
+            _count--;
+        } else {
+            chunk = (SFastBuffer::Chunk*)malloc(sizeof(SFastBuffer::Chunk) + capacity);
+            SASSERT(chunk);
+        }
+        chunk->next = nullptr;
+        chunk->capacity = capacity;
+        chunk->front = 0;
+        chunk->back = 0;
+        return chunk;
+    }
+
+    void release(SFastBuffer::Chunk* chunk) {
+        // Buffers in static objects can be destroyed after the main thread's pool, in which case we just free.
+        if (chunk->capacity == SFastBuffer::CHUNK_SIZE && !_destroyed && _count < SFastBuffer::MAX_POOLED_CHUNKS) {
+            chunk->next = _free;
+            _free = chunk;
+            _count++;
+            return;
+        }
+        ::free(chunk);
+    }
+
+    size_t pooledBytes() const {
+        return _count * SFastBuffer::CHUNK_SIZE;
+    }
+
+    static SFastBufferPool& instance() {
+        thread_local SFastBufferPool pool;
+        return pool;
+    }
+
+  private:
+    SFastBuffer::Chunk* _free = nullptr;
+    size_t _count = 0;
+    bool _destroyed = false;
+};
+
+SFastBuffer::SFastBuffer() : _head(nullptr), _tail(nullptr), _size(0) {
+}
+
+SFastBuffer::SFastBuffer(const string& str) : SFastBuffer() {
+    append(str.data(), str.size());
+}
+
+SFastBuffer::SFastBuffer(const SFastBuffer& other) : SFastBuffer() {
+    for (Chunk* chunk = other._head; chunk; chunk = chunk->next) {
+        append(chunk->data() + chunk->front, chunk->size());
+    }
 }
 
-SFastBuffer::SFastBuffer(const string& str) : front(0), data(str) {
+SFastBuffer::SFastBuffer(SFastBuffer&& other) : _head(other._head), _tail(other._tail), _size(other._size) {
+    other._head = nullptr;
+    other._tail = nullptr;
+    other._size = 0;
+}
+
+SFastBuffer::~SFastBuffer() {
+    _release();
+}
+
+size_t SFastBuffer::pooledBytes() {
+    return SFastBufferPool::instance().pooledBytes();
 }
 
 bool SFastBuffer::empty() const {
-    return size() == 0;
+    return _size == 0;
 }
 
 size_t SFastBuffer::size() const {
-    return data.size() - front;
+    return _size;
 }
 
 const char* SFastBuffer::c_str() const {
-    return data.data() + front;
+    if (!_head) {
+        return "";
+    }
+    if (_head != _tail || _head->back == _head->capacity) {
+        _linearize();
+    }
+    _head->data()[_head->back] = 0;
+    return _head->data() + _head->front;
+}
+
+void SFastBuffer::gather(vector<iovec>& iov, size_t maxVectors) const {
+    for (Chunk* chunk = _head; chunk && iov.size() < maxVectors; chunk = chunk->next) {
+        if (chunk->size()) {
+            iov.push_back({chunk->data() + chunk->front, chunk->size()});
+        }
+    }
 }
 
 void SFastBuffer::clear() {
-    front = 0;
-    data.clear();
+    _release();
 }
 
 void SFastBuffer::consumeFront(size_t bytes) {
-    front += bytes;
+    _size -= bytes;
+    while (bytes) {
+        if (bytes < _head->size()) {
+            _head->front += bytes;
+            break;
+        }
+        bytes -= _head->size();
+        Chunk* next = _head->next;
+        SFastBufferPool::instance().release(_head);
+        _head = next;
+    }
 
-    // If we're all caught up, reset.
-    if (front == data.size()) {
-        clear();
+    // If we're all caught up, give back whatever's left.
+    if (!_size) {
+        _release();
+    } else if (!_head) {
+        _tail = nullptr;
     }
 }
 
-void SFastBuffer::append(const char* buffer, size_t bytes) {
-    // When will we condense everything to the front of the buffer?
-    // When:
-    // 1. We're not already at the front of the buffer (this implies there's data in the buffer).
-    // 2. We'd have to do a realloc anyway because our buffer's not big enough for the new string (including the
-    //    existing consumed buffer).
-    if (front && (data.capacity() - data.size() < bytes)) {
-        memmove(&data[0], data.data() + front, size());
-        data.resize(size());
-        front = 0;
-
-        // If the capacity is more than 4x the size we need, let's give some memory back.
-        if (data.capacity() > (data.size() + bytes) * 4) {
-            data.shrink_to_fit();
+void SFastBuffer::_release() {
+    SFastBufferPool& pool = SFastBufferPool::instance();
+    while (_head) {
+        Chunk* next = _head->next;
+        pool.release(_head);
+        _head = next;
+    }
+    _tail = nullptr;
+    _size = 0;
+}
+
+void SFastBuffer::_linearize() const {
+    SFastBufferPool& pool = SFastBufferPool::instance();
+    const size_t needed = _size + 1;
+    Chunk* joined;
+    Chunk* chunk;
+    if (_head->capacity >= needed) {
+        // Everything fits in the first chunk, so we move its contents to the front and copy the rest after them.
+        joined = _head;
+        memmove(joined->data(), joined->data() + joined->front, joined->size());
+        joined->back = joined->size();
+        joined->front = 0;
+        chunk = joined->next;
+    } else {
+        size_t capacity = CHUNK_SIZE;
+        while (capacity < needed) {
+            capacity *= 2;
         }
+        joined = pool.acquire(capacity);
+        chunk = _head;
+    }
+    while (chunk) {
+        memcpy(joined->data() + joined->back, chunk->data() + chunk->front, chunk->size());
+        joined->back += chunk->size();
+        Chunk* next = chunk->next;
+        pool.release(chunk);
+        chunk = next;
     }
+    joined->next = nullptr;
+    _head = joined;
+    _tail = joined;
+}
 
-    // After the resize, we may or may not need to actually reallocate. We can append now and let the string
-    // implementation decide if it needs more room.
-    data.append(buffer, bytes);
+void SFastBuffer::append(const char* buffer, size_t bytes) {
+    _size += bytes;
+    while (bytes) {
+        if (!_tail || _tail->back == _tail->capacity) {
+            Chunk* chunk = SFastBufferPool::instance().acquire(CHUNK_SIZE);
+            if (_tail) {
+                _tail->next = chunk;
+            } else {
+                _head = chunk;
+            }
+            _tail = chunk;
+        }
+        size_t copied = min(bytes, _tail->capacity - _tail->back);
+        memcpy(_tail->data() + _tail->back, buffer, copied);
+        _tail->back += copied;
+        buffer += copied;
+        bytes -= copied;
+    }
 }
 
 SFastBuffer& SFastBuffer::operator+=(const string& rhs) {
@@ -60,8 +217,31 @@ SFastBuffer& SFastBuffer::operator+=(const string& rhs) {
 }
 
 SFastBuffer& SFastBuffer::operator=(const string& rhs) {
-    front = 0;
-    data = rhs;
+    clear();
+    append(rhs.data(), rhs.size());
+    return *this;
+}
+
+SFastBuffer& SFastBuffer::operator=(const SFastBuffer& rhs) {
+    if (this != &rhs) {
+        clear();
+        for (Chunk* chunk = rhs._head; chunk; chunk = chunk->next) {
+            append(chunk->data() + chunk->front, chunk->size());
+        }
+    }
+    return *this;
+}
+
+SFastBuffer& SFastBuffer::operator=(SFastBuffer&& rhs) {
+    if (this != &rhs) {
+        _release();
+        _head = rhs._head;
+        _tail = rhs._tail;
+        _size = rhs._size;
+        rhs._head = nullptr;
+        rhs._tail = nullptr;
+        rhs._size = 0;
+    }
     return *this;
 }
 
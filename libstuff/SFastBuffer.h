@@ -1,8 +1,23 @@
 #pragma once
+
+// A byte buffer optimized for appending to the back and consuming from the front, as socket buffers do. The contents
+// are held in a chain of chunks: appending fills the last chunk and then adds more, and consuming just moves an offset
+// in the first chunk, giving each chunk back as soon as it's used up. An empty buffer holds no chunks at all, so an
+// idle socket pins no memory however large its last message was.
+//
+// Fixed-size chunks come from a free list kept by each thread, so sockets don't contend with each other for storage.
+//
+// `c_str()` still returns the whole contents as one null-terminated string, so they can be parsed in place. If they
+// span more than one chunk, that joins them into a single chunk first, which is sized in powers of two, and filled by
+// later appends, so a large message that arrives a piece at a time isn't copied over and over. Senders can avoid
+// joining anything by using `gather()`.
 class SFastBuffer {
   public:
     SFastBuffer();
     SFastBuffer(const string& str);
+    SFastBuffer(const SFastBuffer& other);
+    SFastBuffer(SFastBuffer&& other);
+    ~SFastBuffer();
     bool empty() const;
     size_t size() const;
     const char* c_str() const;
@@ -11,9 +26,36 @@ class SFastBuffer {
     void append(const char* buffer, size_t bytes);
     SFastBuffer& operator+=(const string& rhs);
     SFastBuffer& operator=(const string& rhs);
+    SFastBuffer& operator=(const SFastBuffer& rhs);
+    SFastBuffer& operator=(SFastBuffer&& rhs);
+
+    // Appends an entry to `iov` for each chunk, in order, until it has `maxVectors` entries.
+    void gather(vector<iovec>& iov, size_t maxVectors = IOV_MAX) const;
+
+    // The size of the chunks we allocate, and the most of them each thread keeps for reuse.
+    static const size_t CHUNK_SIZE = 16 * 1024;
+    static const size_t MAX_POOLED_CHUNKS = 64;
+
+    // A socket stops reading into its receive buffer while it holds this much, leaving the rest for TCP to hold back
+    // until it's consumed. A single message can't be larger than this.
+    static const size_t MAX_RECV_SIZE = 64 * 1024 * 1024;
+
+    // Returns the number of bytes held in the calling thread's free list, waiting for reuse.
+    static size_t pooledBytes();
 
   private:
-    size_t front;
-    string data;
+    friend class SFastBufferPool;
+    struct Chunk;
+
+    // Joins the contents into a single chunk with room for a null terminator.
+    void _linearize() const;
+
+    // Gives back every chunk.
+    void _release();
+
+    // These change when `c_str()` joins the chunks together, which doesn't change the contents.
+    mutable Chunk* _head;
+    mutable Chunk* _tail;
+    size_t _size;
 };
 ostream& operator<<(ostream& os, const SFastBuffer& buf);
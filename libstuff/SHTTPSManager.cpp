@@ -20,6 +20,9 @@ void SHTTPSManager::validate() {
     }
 }
 
+atomic<size_t> SStandaloneHTTPSManager::maxIdleSocketsPerHost(4);
+atomic<uint64_t> SStandaloneHTTPSManager::idleSocketTimeoutMS(4000);
+
 SStandaloneHTTPSManager::SStandaloneHTTPSManager()
 {
 }
@@ -41,6 +44,12 @@ SStandaloneHTTPSManager::~SStandaloneHTTPSManager() {
     while (!_completedTransactionList.empty()) {
         closeTransaction(_completedTransactionList.front());
     }
+    for (auto& hostSockets : _idleSockets) {
+        for (auto& idle : hostSockets.second) {
+            closeSocket(idle.socket);
+        }
+    }
+    _idleSockets.clear();
 }
 
 void SStandaloneHTTPSManager::closeTransaction(Transaction* transaction) {
@@ -53,7 +62,18 @@ void SStandaloneHTTPSManager::closeTransaction(Transaction* transaction) {
     _activeTransactionList.remove(transaction);
     _completedTransactionList.remove(transaction);
     if (transaction->s) {
-        closeSocket(transaction->s);
+        if (_canReuseSocket(transaction)) {
+            // Keep the connection around for the next transaction to the same place, closing the oldest if we have too
+            // many.
+            list<IdleSocket>& idleSockets = _idleSockets[transaction->connectionKey];
+            if (idleSockets.size() >= maxIdleSocketsPerHost.load()) {
+                closeSocket(idleSockets.front().socket);
+                idleSockets.pop_front();
+            }
+            idleSockets.push_back({transaction->s, STimeNow()});
+        } else {
+            closeSocket(transaction->s);
+        }
     }
     transaction->s = nullptr;
     delete transaction;
@@ -87,6 +107,92 @@ void SStandaloneHTTPSManager::closeSocket(Socket* socket) {
     STCPManager::closeSocket(socket);
 }
 
+bool SStandaloneHTTPSManager::_canReuseSocket(Transaction* transaction) {
+    // We can only reuse a connection if we got a complete response and nothing else, with nothing left to send, and
+    // neither side asked to close it.
+    Socket* s = transaction->s;
+    const SData& response = transaction->fullResponse;
+    if (!maxIdleSocketsPerHost.load() || transaction->connectionKey.empty() || response.methodLine.empty() ||
+        s->state.load() != Socket::CONNECTED || !s->recvBuffer.empty() || !s->sendBufferEmpty()) {
+        return false;
+    }
+    if (SIEquals(transaction->fullRequest["Connection"], "close") || SIEquals(response["Connection"], "close")) {
+        return false;
+    }
+
+    // The response has to have said where it ends. One without a length that isn't chunked runs until the server closes
+    // the connection, so all we've parsed is its headers, and the rest of it would be read as the next response. Only
+    // 204 and 304 responses never have a body.
+    const int status = SToInt(response.methodLine.substr(response.methodLine.find(' ') + 1));
+    if (!response.isSet("Content-Length") && !SIEquals(response["Transfer-Encoding"], "chunked") &&
+        status != 204 && status != 304) {
+        return false;
+    }
+
+    // HTTP/1.0 servers close connections unless they say otherwise.
+    return !SStartsWith(response.methodLine, "HTTP/1.0") || SIEquals(response["Connection"], "keep-alive");
+}
+
+SStandaloneHTTPSManager::Socket* SStandaloneHTTPSManager::_takeIdleSocket(const string& connectionKey) {
+    SAUTOLOCK(_listMutex);
+    auto it = _idleSockets.find(connectionKey);
+    if (it == _idleSockets.end()) {
+        return nullptr;
+    }
+
+    // Take the most recently used connection, as it's the least likely to have been closed by the server. Before
+    // reusing it, make sure the server hasn't closed it or sent anything since, by peeking at the socket, as the
+    // server may have closed it since we last polled.
+    list<IdleSocket>& idleSockets = it->second;
+    const uint64_t timeout = idleSocketTimeoutMS.load() * 1000;
+    Socket* socket = nullptr;
+    while (!socket && !idleSockets.empty()) {
+        IdleSocket idle = idleSockets.back();
+        idleSockets.pop_back();
+        char byte;
+        ssize_t peeked = ::recv(idle.socket->s, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        bool healthy = peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        if (healthy && idle.socket->state.load() == Socket::CONNECTED && idle.socket->recvBuffer.empty() &&
+            STimeNow() < idle.idleSince + timeout) {
+            socket = idle.socket;
+        } else {
+            SINFO("Discarding idle connection to '" << idle.socket->addr << "' that's no longer usable.");
+            closeSocket(idle.socket);
+        }
+    }
+    if (idleSockets.empty()) {
+        _idleSockets.erase(it);
+    }
+    if (socket) {
+        socket->recvParser.reset();
+    }
+    return socket;
+}
+
+void SStandaloneHTTPSManager::_pruneIdleSockets(uint64_t& nextActivity) {
+    const uint64_t now = STimeNow();
+    const uint64_t timeout = idleSocketTimeoutMS.load() * 1000;
+    for (auto hostIt = _idleSockets.begin(); hostIt != _idleSockets.end();) {
+        list<IdleSocket>& idleSockets = hostIt->second;
+        for (auto it = idleSockets.begin(); it != idleSockets.end();) {
+            // Anything the server sends while we're not waiting for a response means we can't use the connection.
+            if (it->socket->state.load() != Socket::CONNECTED || !it->socket->recvBuffer.empty() ||
+                now >= it->idleSince + timeout) {
+                closeSocket(it->socket);
+                it = idleSockets.erase(it);
+            } else {
+                nextActivity = min(nextActivity, it->idleSince + timeout);
+                it++;
+            }
+        }
+        if (idleSockets.empty()) {
+            hostIt = _idleSockets.erase(hostIt);
+        } else {
+            hostIt++;
+        }
+    }
+}
+
 void SStandaloneHTTPSManager::prePoll(fd_map& fdm) {
     // Just call the base class function but in a thread-safe way.
     SAUTOLOCK(_listMutex);
@@ -109,6 +215,7 @@ void SStandaloneHTTPSManager::postPoll(fd_map& fdm, uint64_t& nextActivity, list
 
     // Let the base class do its thing
     STCPManager::postPoll(fdm);
+    _pruneIdleSockets(nextActivity);
 
     // Update each of the active requests
     uint64_t timeout = timeoutMS * 1000;
@@ -127,7 +234,7 @@ void SStandaloneHTTPSManager::postPoll(fd_map& fdm, uint64_t& nextActivity, list
         uint64_t timeoutFromTime = active->sentTime ? active->sentTime : active->created;
         uint64_t now = STimeNow();
         uint64_t elapsed = now - timeoutFromTime;
-        int size = active->fullResponse.deserialize(active->s->recvBuffer);
+        int size = active->fullResponse.deserialize(active->s->recvBuffer, active->s->recvParser);
         auto timeoutIt = transactionTimeouts.find(active);
         bool specificallyTimedOut = timeoutIt != transactionTimeouts.end() && timeoutIt->second < now;
         if (size) {
@@ -216,15 +323,22 @@ SStandaloneHTTPSManager::Transaction* SStandaloneHTTPSManager::_httpsSend(const
     // Create a new transaction. This can throw if `validate` fails. We explicitly do this *before* creating a socket.
     Transaction* transaction = new Transaction(*this);
 
-    // If this is going to be an https transaction, create a certificate and give it to the socket.
-    SX509* x509 = SStartsWith(url, "https://") ? SX509Open(_pem, _srvCrt, _caCrt) : nullptr;
-    Socket* s = openSocket(host, x509);
+    // Reuse an open connection to the same place if we have one. Otherwise, open a new one, and if this is going to
+    // be an https transaction, create a certificate and give it to the socket.
+    const bool https = SStartsWith(url, "https://");
+    const string connectionKey = (https ? "https://" : "http://") + host;
+    Socket* s = _takeIdleSocket(connectionKey);
+    if (!s) {
+        SX509* x509 = https ? SX509Open(_pem, _srvCrt, _caCrt) : nullptr;
+        s = openSocket(host, x509);
+    }
     if (!s) {
         delete transaction;
         return _createErrorTransaction();
     }
 
     transaction->s = s;
+    transaction->connectionKey = connectionKey;
     transaction->fullRequest = request;
 
     // Ship it.
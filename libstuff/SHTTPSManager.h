@@ -22,6 +22,10 @@ class SStandaloneHTTPSManager : public STCPManager {
         bool isDelayedSend;
         uint64_t sentTime;
         const string requestID;
+
+        // Identifies the scheme and host that `s` is connected to, so that once this transaction is finished, `s` can
+        // be kept open and reused by a later transaction to the same place. Empty if `s` shouldn't be reused.
+        string connectionKey;
     };
 
     // Constructor/Destructor
@@ -45,6 +49,13 @@ class SStandaloneHTTPSManager : public STCPManager {
 
     static int getHTTPResponseCode(const string& methodLine);
 
+    // Finished transactions leave their connections open for reuse by later transactions to the same host, if the
+    // server allows it. These control how many idle connections we keep for each host (0 disables reuse), and how long
+    // each one can sit idle before we close it. They should be shorter than the servers we talk to keep idle
+    // connections open.
+    static atomic<size_t> maxIdleSocketsPerHost;
+    static atomic<uint64_t> idleSocketTimeoutMS;
+
     virtual void validate() {
         // The constructor for a transaction needs to call this on it's manager. It can then throw in cases where this
         // manager should not be allowed to create transactions. This lets us have different validation behavior for
@@ -67,6 +78,23 @@ class SStandaloneHTTPSManager : public STCPManager {
     list<Transaction*> _activeTransactionList;
     list<Transaction*> _completedTransactionList;
 
+    // Open connections not in use by any transaction, by `Transaction::connectionKey`, most recently used last.
+    struct IdleSocket {
+        Socket* socket;
+        uint64_t idleSince;
+    };
+    map<string, list<IdleSocket>> _idleSockets;
+
+    // Returns a healthy idle connection for `connectionKey`, or nullptr if there isn't one.
+    Socket* _takeIdleSocket(const string& connectionKey);
+
+    // Returns true if `transaction`'s socket can be reused once the transaction is closed.
+    bool _canReuseSocket(Transaction* transaction);
+
+    // Closes idle connections that have expired or been closed by the server, and updates `nextActivity` with when the
+    // next one will expire.
+    void _pruneIdleSockets(uint64_t& nextActivity);
+
     // SStandaloneHTTPSManager operations are thread-safe, we lock around any accesses to our transaction lists, so that
     // multiple threads can add/remove from them.
     recursive_mutex _listMutex;
@@ -0,0 +1,111 @@
+#pragma once
+
+// A lock-free queue that any number of threads can push to, but only a single thread can pop from. Pushing is a single
+// atomic exchange plus a store, so producers never wait on each other or on the consumer.
+//
+// Like SSynchronizedQueue, this can be watched by a `poll` loop: a push wakes the consumer's `poll` by writing to a
+// pipe. To avoid a system call on every push, only a push that finds the queue's `_wakePending` flag clear writes to
+// the pipe, and the consumer clears the flag in `postPoll` before it starts popping. Anything pushed after that is
+// either seen by the consumer's pops, or writes to the pipe again.
+//
+// `T` must be default constructible and movable.
+template <typename T>
+class SMPSCQueue {
+  public:
+    SMPSCQueue();
+    ~SMPSCQueue();
+
+    SMPSCQueue(const SMPSCQueue& other) = delete;
+
+    // Adds an item to the queue. Safe to call from any thread.
+    void push(T&& item);
+
+    // Removes the oldest item and moves it into `item`, returning false if there's nothing to remove. Must only be
+    // called from the consuming thread. An item whose `push` hasn't finished yet may not be returned until a later
+    // call.
+    bool pop(T& item);
+
+    // Called by the consuming thread around `poll`.
+    void prePoll(fd_map& fdm);
+    void postPoll(fd_map& fdm);
+
+  private:
+    struct Node {
+        Node() : next(nullptr) {}
+        Node(T&& value_) : next(nullptr), value(move(value_)) {}
+        atomic<Node*> next;
+        T value;
+    };
+
+    // Producers link new nodes after `_head`. The consumer reads from the node after `_tail`, which is always a node
+    // whose value has already been consumed (initially an empty one).
+    atomic<Node*> _head;
+    Node* _tail;
+
+    // Set when a wake-up has been written to the pipe and not yet handled.
+    atomic<bool> _wakePending;
+    int _pipeFD[2] = {-1, -1};
+};
+
+template <typename T>
+SMPSCQueue<T>::SMPSCQueue() : _wakePending(false) {
+    Node* stub = new Node();
+    _head.store(stub);
+    _tail = stub;
+
+    // Both ends are non-blocking. There's never more than one byte in the pipe, but there's no reason to risk it.
+    SASSERT(0 == pipe(_pipeFD));
+    fcntl(_pipeFD[0], F_SETFL, fcntl(_pipeFD[0], F_GETFL, 0) | O_NONBLOCK);
+    fcntl(_pipeFD[1], F_SETFL, fcntl(_pipeFD[1], F_GETFL, 0) | O_NONBLOCK);
+}
+
+template <typename T>
+SMPSCQueue<T>::~SMPSCQueue() {
+    T item;
+    while (pop(item)) {}
+    delete _tail;
+    close(_pipeFD[0]);
+    close(_pipeFD[1]);
+}
+
+template <typename T>
+void SMPSCQueue<T>::push(T&& item) {
+    Node* node = new Node(move(item));
+    Node* previous = _head.exchange(node, memory_order_acq_rel);
+    previous->next.store(node, memory_order_release);
+
+    // This must come after the node is linked, so a consumer that clears the flag after we set it will see the node.
+    if (!_wakePending.exchange(true)) {
+        if (write(_pipeFD[1], "A", 1) != 1 && errno != EAGAIN) {
+            SWARN("Couldn't wake queue consumer: '" << strerror(errno) << "' (#" << errno << ").");
+        }
+    }
+}
+
+template <typename T>
+bool SMPSCQueue<T>::pop(T& item) {
+    Node* next = _tail->next.load(memory_order_acquire);
+    if (!next) {
+        return false;
+    }
+    item = move(next->value);
+    delete _tail;
+    _tail = next;
+    return true;
+}
+
+template <typename T>
+void SMPSCQueue<T>::prePoll(fd_map& fdm) {
+    SFDset(fdm, _pipeFD[0], SREADEVTS);
+}
+
+template <typename T>
+void SMPSCQueue<T>::postPoll(fd_map& fdm) {
+    if (SFDAnySet(fdm, _pipeFD[0], SREADEVTS)) {
+        char buffer[16];
+        while (read(_pipeFD[0], buffer, sizeof(buffer)) > 0) {}
+    }
+
+    // The consumer pops after this, so anything pushed before a producer saw the flag set is popped below.
+    _wakePending.exchange(false);
+}
@@ -2,7 +2,79 @@
 #include <mbedtls/error.h>
 #include <mbedtls/net.h>
 
-SSSLState::SSSLState() {
+mutex SSSLSessionCache::_mutex;
+map<string, unique_ptr<SSSLSessionCache::Session>> SSSLSessionCache::_sessions;
+atomic<uint64_t> SSSLSessionCache::_hits(0);
+atomic<uint64_t> SSSLSessionCache::_misses(0);
+
+string SSSLSessionCache::key(const string& host, const SX509* x509) {
+    if (!x509 || !x509->srvcert.raw.p) {
+        return host;
+    }
+    return host + "#" + SToHex(SHashSHA256(string((const char*)x509->srvcert.raw.p, x509->srvcert.raw.len)));
+}
+
+string SSSLSessionCache::_identify(const mbedtls_ssl_session& session) {
+    return SHashSHA256(string((const char*)session.master, sizeof(session.master)));
+}
+
+string SSSLSessionCache::load(const string& key, mbedtls_ssl_context& ssl) {
+    lock_guard<mutex> lock(_mutex);
+    auto it = _sessions.find(key);
+    if (it == _sessions.end() || mbedtls_ssl_set_session(&ssl, &it->second->session)) {
+        return "";
+    }
+    return _identify(it->second->session);
+}
+
+void SSSLSessionCache::save(const string& key, const mbedtls_ssl_context& ssl, const string& offered) {
+    unique_ptr<Session> session = make_unique<Session>();
+    if (mbedtls_ssl_get_session(&ssl, &session->session)) {
+        SINFO("Couldn't get TLS session for '" << key << "' to cache.");
+        _misses++;
+        return;
+    }
+    if (!offered.empty() && _identify(session->session) == offered) {
+        _hits++;
+    } else {
+        _misses++;
+    }
+    lock_guard<mutex> lock(_mutex);
+    auto it = _sessions.find(key);
+    if (it != _sessions.end()) {
+        it->second = move(session);
+        return;
+    }
+
+    // We only ever hear from a few partners, so if we somehow fill up, it's not worth being clever about what to drop.
+    if (_sessions.size() >= MAX_HOSTS) {
+        _sessions.erase(_sessions.begin());
+    }
+    _sessions.emplace(key, move(session));
+}
+
+void SSSLSessionCache::forget(const string& key) {
+    _misses++;
+    lock_guard<mutex> lock(_mutex);
+    _sessions.erase(key);
+}
+
+// Called after each read or write, as that's what drives the handshake. Once the handshake is over, we cache its
+// session, and if it fails, we make sure we don't offer the same session again.
+static void _updateSessionCache(SSSLState* sslState, bool failed) {
+    if (sslState->sessionCached || sslState->sessionKey.empty()) {
+        return;
+    }
+    if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+        SSSLSessionCache::save(sslState->sessionKey, sslState->ssl, sslState->offeredSession);
+        sslState->sessionCached = true;
+    } else if (failed) {
+        SSSLSessionCache::forget(sslState->sessionKey);
+        sslState->sessionCached = true;
+    }
+}
+
+SSSLState::SSSLState() : sessionCached(false) {
     mbedtls_ssl_init(&ssl);
     mbedtls_ssl_config_init(&conf);
     mbedtls_ctr_drbg_init(&ctr_drbg);
@@ -17,7 +89,7 @@ SSSLState::~SSSLState() {
 }
 
 // --------------------------------------------------------------------------
-SSSLState* SSSLOpen(int s, SX509* x509) {
+SSSLState* SSSLOpen(int s, SX509* x509, const string& host) {
     // Initialize the SSL state
     SASSERT(s >= 0);
     SSSLState* state = new SSSLState;
@@ -25,6 +97,9 @@ SSSLState* SSSLOpen(int s, SX509* x509) {
 
     mbedtls_ctr_drbg_seed(&state->ctr_drbg, mbedtls_entropy_func, &state->ec, 0, 0);
     mbedtls_ssl_config_defaults(&state->conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM, 0);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(&state->conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
 
     mbedtls_ssl_setup(&state->ssl, &state->conf);
 
@@ -37,6 +112,12 @@ SSSLState* SSSLOpen(int s, SX509* x509) {
         mbedtls_ssl_conf_ca_chain(&state->conf, x509->srvcert.next, 0);
         SASSERT(mbedtls_ssl_conf_own_cert(&state->conf, &x509->srvcert, &x509->pk) == 0);
     }
+
+    // Try to resume our last session with this host, if it was made with the same certificate.
+    if (!host.empty()) {
+        state->sessionKey = SSSLSessionCache::key(host, x509);
+        state->offeredSession = SSSLSessionCache::load(state->sessionKey, state->ssl);
+    }
     return state;
 }
 
@@ -45,6 +126,8 @@ int SSSLSend(SSSLState* sslState, const char* buffer, int length) {
     // Send as much as possible and report what happened
     SASSERT(sslState && buffer);
     const int numSent = mbedtls_ssl_write(&sslState->ssl, (unsigned char*)buffer, length);
+    _updateSessionCache(sslState, numSent < 0 && numSent != MBEDTLS_ERR_SSL_WANT_READ &&
+                                  numSent != MBEDTLS_ERR_SSL_WANT_WRITE && numSent != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY);
     if (numSent > 0) {
         return numSent;
     }
@@ -70,6 +153,8 @@ int SSSLRecv(SSSLState* sslState, char* buffer, int length) {
     // Receive as much as we can and report what happened
     SASSERT(sslState && buffer);
     const int numRecv = mbedtls_ssl_read(&sslState->ssl, (unsigned char*)buffer, length);
+    _updateSessionCache(sslState, numRecv < 0 && numRecv != MBEDTLS_ERR_SSL_WANT_READ &&
+                                  numRecv != MBEDTLS_ERR_SSL_WANT_WRITE);
     if (numRecv > 0) {
         return numRecv;
     }
@@ -147,8 +232,13 @@ void SSSLClose(SSSLState* ssl) {
 
 // --------------------------------------------------------------------------
 int SSSLSend(SSSLState* ssl, const SFastBuffer& buffer) {
-    // Unwind the buffer
-    return SSSLSend(ssl, buffer.c_str(), (int)buffer.size());
+    // Send what we can of the first chunk; SSL records are smaller than a chunk anyway.
+    vector<iovec> iov;
+    buffer.gather(iov, 1);
+    if (iov.empty()) {
+        return 0;
+    }
+    return SSSLSend(ssl, (const char*)iov.front().iov_base, (int)iov.front().iov_len);
 }
 
 // --------------------------------------------------------------------------
@@ -190,7 +280,11 @@ bool SSSLRecvAppend(SSSLState* ssl, SFastBuffer& recvBuffer) {
     char buffer[1024 * 16];
     int totalRecv = 0;
     int numRecv = 0;
-    while ((numRecv = SSSLRecv(ssl, buffer, sizeof(buffer))) > 0) {
+    if (recvBuffer.size() >= SFastBuffer::MAX_RECV_SIZE) {
+        SWARN("Receive buffer holds " << recvBuffer.size() << " bytes without a complete message, closing.");
+        return false;
+    }
+    while (recvBuffer.size() < SFastBuffer::MAX_RECV_SIZE && (numRecv = SSSLRecv(ssl, buffer, sizeof(buffer))) > 0) {
         // Got some more data
         recvBuffer.append(buffer, numRecv);
         totalRecv += numRecv;
@@ -12,12 +12,68 @@ struct SSSLState {
     mbedtls_ssl_config conf;
     mbedtls_ssl_context ssl;
 
+    // The key for this connection's entry in SSSLSessionCache. Empty if its session isn't cached.
+    string sessionKey;
+
+    // Identifies the cached session we offered to resume, if any, as returned by `SSSLSessionCache::load`.
+    string offeredSession;
+
+    // Set once the session from our handshake has been saved to the cache, or once the handshake has failed.
+    bool sessionCached;
+
     SSSLState();
     ~SSSLState();
 };
 
-// SSL helpers
-extern SSSLState* SSSLOpen(int s, SX509* x509);
+// Remembers the most recent TLS session negotiated with each host, so that a new connection to that host can resume it
+// with an abbreviated handshake rather than a full one. The session includes the server's session ticket, if it sent
+// one, so this works with servers that resume by session ID and servers that resume by ticket. If a server declines to
+// resume, mbedtls falls back to a full handshake. Safe to use from multiple threads.
+//
+// Sessions are cached per host and client certificate, as resuming a session skips client authentication, so a session
+// negotiated with one certificate must never be resumed by a connection using another.
+class SSSLSessionCache {
+  public:
+    // Returns the cache key for connections to `host` that authenticate with `x509`.
+    static string key(const string& host, const SX509* x509);
+
+    // Offers the cached session for `key` to `ssl`, which must not have started its handshake. Returns a value that
+    // identifies the session offered, to pass to `save`, or an empty string if we have no session for `key`.
+    static string load(const string& key, mbedtls_ssl_context& ssl);
+
+    // Saves the session from `ssl`, which has completed its handshake, for `key`. `offered` is what `load` returned for
+    // this connection. The connection counts as a hit if it actually resumed that session, and a miss otherwise.
+    static void save(const string& key, const mbedtls_ssl_context& ssl, const string& offered);
+
+    // Discards the cached session for `key`, e.g. because a handshake that offered it failed. Counts a miss.
+    static void forget(const string& key);
+
+    // The number of connections that did and didn't resume a cached session.
+    static uint64_t hits() { return _hits.load(); }
+    static uint64_t misses() { return _misses.load(); }
+
+    // The most hosts we'll keep sessions for.
+    static const size_t MAX_HOSTS = 1000;
+
+  private:
+    // Identifies a session by a hash of its master secret, which a resumed session shares with the session it resumed,
+    // and a full handshake never does.
+    static string _identify(const mbedtls_ssl_session& session);
+
+    struct Session {
+        Session() { mbedtls_ssl_session_init(&session); }
+        ~Session() { mbedtls_ssl_session_free(&session); }
+        mbedtls_ssl_session session;
+    };
+
+    static mutex _mutex;
+    static map<string, unique_ptr<Session>> _sessions;
+    static atomic<uint64_t> _hits;
+    static atomic<uint64_t> _misses;
+};
+
+// SSL helpers. If `host` is given, the session is cached in SSSLSessionCache and reused by later connections to it.
+extern SSSLState* SSSLOpen(int s, SX509* x509, const string& host = "");
 extern int SSSLSend(SSSLState* ssl, const char* buffer, int length);
 extern int SSSLSend(SSSLState* ssl, const SFastBuffer& buffer);
 extern bool SSSLSendConsume(SSSLState* ssl, SFastBuffer& sendBuffer);
@@ -0,0 +1,664 @@
+#pragma once
+#include <libstuff/libstuff.h>
+#include <libstuff/STimerWheel.h>
+
+// A sharded version of SScheduledPriorityQueue, with the same notion of what counts as the next item (see the comment
+// at the top of SScheduledPriorityQueue.h), for queues that many threads push to and pop from at once.
+//
+// Rather than one mutex around one tree, items are spread across several shards (typically one per consuming thread),
+// each with its own mutex. Within a shard, each priority level is a binary heap in a flat vector of the items that are
+// ready, ordered by scheduled time and then by the order items were pushed, and items themselves live in a reusable
+// array of slots, so a steady queue doesn't allocate on push or pop. Each shard publishes a summary of its next item
+// (its priority, scheduled time and push order, and whether anything has timed out) in atomics, so a consumer can pick
+// the shard holding the next item without taking any locks, and then lock only that shard to take it. Any consumer can
+// take from any shard, so no item waits behind a busy thread. If two consumers race for the same item, the loser
+// falls back to checking each shard in turn.
+//
+// Items scheduled in the future, and every item's timeout, are kept in per-shard STimerWheels, which move items onto
+// their priority level when they're due, and onto a list of timed out items when their timeout passes. Each shard also
+// publishes when its timers are next due, and consumers waiting in `get` wake up at that time, rather than only when
+// something is pushed or their wait is over.
+//
+// Items can also be pushed with a flow, such as the client they came from. Within a priority, ready items from
+// different flows are served by deficit round-robin: each flow with items waiting takes a turn, and gets as many items
+// per turn as its weight (1 by default), so one flow with a deep backlog can't starve the others. Within a flow, items
+// are still taken in order of scheduled time and then push order. Everything pushed without a flow is one flow, which
+// gives the same order as SScheduledPriorityQueue.
+//
+// Turns are also taken across shards. A flow's items are spread over every shard, so each shard's rotation alone would
+// let a flow with a deep backlog be next in most of them. So the queue also counts how much each flow has been served,
+// relative to its weight, and consumers choose between shards by whichever shard's next flow has been served least.
+// A flow that's been idle starts level with whatever was served most recently, rather than with credit for the time it
+// was idle. This isn't exact, as each shard only shows the flow whose turn it is there, so a flow waiting behind the
+// flood in one shard's rotation isn't seen until that shard's turn moves on. But the flood gets roughly every other
+// item at most, rather than everything it pushed before anyone else.
+//
+// Optionally, ready items can be ordered by their timeouts instead of their scheduled times, so within a priority (and
+// a flow), whatever's closest to its deadline goes first.
+//
+// Items removed by `get` are passed to the end function without any lock held. `T` must be default constructible and
+// movable.
+template<typename T>
+class SShardedPriorityQueue {
+  public:
+    typedef int Priority;
+    typedef uint64_t Timeout;
+    typedef uint64_t Scheduled;
+
+    // If nothing becomes available to dequeue while waiting, a timeout_error exception is thrown.
+    class timeout_error : exception {
+      public:
+        const char* what() const noexcept {
+            return "timeout";
+        }
+    };
+
+    // `shards` of 0 uses one per hardware thread.
+    SShardedPriorityQueue(size_t shards = 0,
+                          function<void(T& item)> startFunction = [](T& item){},
+                          function<void(T& item)> endFunction = [](T& item){});
+
+    // Remove all items from the queue.
+    void clear();
+
+    // Returns true if there are no queued items.
+    bool empty() { return !_size.load(); }
+
+    // Returns the size of the queue.
+    size_t size() { return _size.load(); }
+
+    // Get an item from the queue. If waitUS is non-zero, a timeout_error exception will be thrown after waitUS
+    // microseconds, if no work was available.
+    T get(uint64_t waitUS = 0);
+
+    // Add an item to the queue. The queue takes ownership of the item and the caller's copy is invalidated.
+    void push(T&& item, Priority priority, Scheduled scheduled, Timeout timeout, const string& flow = "");
+
+    // Sets how many items each flow gets per turn. Flows not listed get 1. This must be called before the queue is in
+    // use.
+    void setFlowWeights(const map<string, size_t>& weights) { _flowWeights = weights; }
+
+    // Orders ready items by timeout, earliest first, rather than by scheduled time. This must be called before the
+    // queue is in use.
+    void setDeadlineOrdering(bool enabled) { _orderByDeadline = enabled; }
+
+    // Calls `callback` on every queued item, one shard at a time.
+    void forEach(function<void(const T& item)> callback);
+
+    // Removes every item scheduled at or after `scheduled`, without calling the end function, and returns how many
+    // were removed.
+    size_t eraseScheduledAfter(Scheduled scheduled);
+
+    size_t shardCount() const { return _shards.size(); }
+
+  protected:
+    // An entry in one of a shard's heaps. `key` is the scheduled time or the timeout, depending on the heap. An entry
+    // is stale, and skipped, once its slot no longer holds the item with the same `sequence`.
+    struct Entry {
+        uint64_t key;
+        uint64_t sequence;
+        uint32_t slot;
+    };
+
+    struct Slot {
+        T item;
+        Priority priority;
+        Scheduled scheduled;
+        Timeout timeout;
+        uint64_t sequence;
+        string flow;
+        bool live;
+
+        // True once the item is on its priority level, rather than waiting for its scheduled time.
+        bool ready;
+    };
+
+    // The ready items of one flow at one priority. `credit` is how many more items the flow can have before its turn
+    // is over, and `active` is whether it's in its level's rotation.
+    struct Flow {
+        vector<Entry> heap;
+        size_t live = 0;
+        size_t credit = 0;
+        bool active = false;
+    };
+
+    // Flows are erased once they're empty and their turn comes round, so idle clients don't accumulate.
+    struct Level {
+        Priority priority;
+        map<string, Flow> flows;
+        deque<typename map<string, Flow>::iterator> rotation;
+    };
+
+    // Shards are aligned to keep each one's mutex and summary off its neighbors' cache lines.
+    struct alignas(64) Shard {
+        mutex shardMutex;
+        vector<Slot> slots;
+        vector<uint32_t> freeSlots;
+
+        // Levels are kept in order of priority, highest first. There are only ever a handful. They're in a list so
+        // they never move, as each one's rotation refers into its own map of flows.
+        list<Level> levels;
+        size_t live = 0;
+
+        // Items waiting for their scheduled time, every item's timeout, and the items whose timeouts have passed, in
+        // the order they did. `timersChanged` is set when the wheels change, so we know to update `nextDue`.
+        STimerWheel<Entry> scheduledTimers;
+        STimerWheel<Entry> timeoutTimers;
+        deque<Entry> timedOut;
+        bool timersChanged = false;
+
+        // The summary of the next item, written with `shardMutex` held and read without it.
+        atomic<Priority> bestPriority{NO_PRIORITY};
+        atomic<uint64_t> bestKey{0};
+        atomic<uint64_t> bestSequence{0};
+        atomic<size_t> bestFlow{0};
+        atomic<Timeout> firstTimedOut{UINT64_MAX};
+        atomic<uint64_t> nextDue{UINT64_MAX};
+    };
+
+    // The `bestPriority` of an empty shard.
+    static constexpr Priority NO_PRIORITY = numeric_limits<Priority>::min();
+
+    // Orders heaps so the entry with the smallest key, then the smallest sequence, is at the front.
+    static bool _after(const Entry& a, const Entry& b) {
+        return a.key != b.key ? a.key > b.key : a.sequence > b.sequence;
+    }
+
+    // All of these are called with the shard's mutex held.
+    static bool _isLive(const Shard& shard, const Entry& entry);
+    static void _popStale(const Shard& shard, vector<Entry>& heap);
+    static void _compact(const Shard& shard, vector<Entry>& heap, size_t live);
+    static void _compactTimers(Shard& shard, STimerWheel<Entry>& timers);
+    void _makeReady(Shard& shard, const Entry& entry);
+    void _advance(Shard& shard, uint64_t now);
+    Flow* _nextFlow(const Shard& shard, Level& level);
+    void _updateSummary(Shard& shard);
+    T _remove(Shard& shard, uint32_t slot);
+    bool _dequeue(Shard& shard, uint64_t now, T& item);
+
+    // Takes the next item from whichever shard has it, returning false if nothing is ready.
+    bool _tryGet(T& item);
+
+    // How much a flow has been served, and charges it for another item. Flows are identified by the hash of their
+    // names, so they can be published in a shard's summary. Called with `_serviceMutex` held.
+    uint64_t _serviceOf(size_t flowHash);
+    void _charge(const string& flow);
+
+    // Returns the earliest time any shard's timers are next due.
+    uint64_t _nextDue();
+
+    vector<unique_ptr<Shard>> _shards;
+    atomic<size_t> _size;
+
+    // Orders all pushes, and chooses the shard each one goes to.
+    atomic<uint64_t> _nextSequence;
+
+    // Consumers with nothing to do wait here. Pushes only touch the mutex when `_sleepers` shows someone is waiting.
+    mutex _sleepMutex;
+    condition_variable _wakeCondition;
+    atomic<size_t> _sleepers;
+
+    map<string, size_t> _flowWeights;
+    bool _orderByDeadline;
+
+    // Each item costs this much service, divided by its flow's weight.
+    static constexpr uint64_t SERVICE_PER_ITEM = 1 << 20;
+
+    // The most flows we'll keep service counts for before forgetting the ones that are no further ahead than
+    // `_virtualTime`, which is the same as not knowing them at all.
+    static constexpr size_t MAX_FLOW_SERVICE = 1024;
+
+    // Service counts, and the service count of the item served most recently. `_flowsInUse` is set once anything has
+    // been pushed with a flow, and until then, none of this is needed.
+    mutex _serviceMutex;
+    unordered_map<size_t, uint64_t> _flowService;
+    uint64_t _virtualTime;
+    atomic<bool> _flowsInUse;
+
+    // Functions to call on each item when inserting or removing from the queue.
+    function<void(T&)> _startFunction;
+    function<void(T&)> _endFunction;
+};
+
+template<typename T>
+SShardedPriorityQueue<T>::SShardedPriorityQueue(size_t shards, function<void(T& item)> startFunction,
+                                                function<void(T& item)> endFunction)
+  : _size(0), _nextSequence(0), _sleepers(0), _orderByDeadline(false), _virtualTime(0), _flowsInUse(false),
+    _startFunction(startFunction), _endFunction(endFunction)
+{
+    if (!shards) {
+        shards = max(thread::hardware_concurrency(), 1u);
+    }
+    for (size_t i = 0; i < shards; i++) {
+        _shards.emplace_back(make_unique<Shard>());
+    }
+}
+
+template<typename T>
+bool SShardedPriorityQueue<T>::_isLive(const Shard& shard, const Entry& entry) {
+    const Slot& slot = shard.slots[entry.slot];
+    return slot.live && slot.sequence == entry.sequence;
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_popStale(const Shard& shard, vector<Entry>& heap) {
+    while (!heap.empty() && !_isLive(shard, heap.front())) {
+        pop_heap(heap.begin(), heap.end(), _after);
+        heap.pop_back();
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_compact(const Shard& shard, vector<Entry>& heap, size_t live) {
+    // Stale entries are normally dropped when they reach the front, but one whose key is far off (e.g., the timeout of
+    // an item that's already been dequeued) can sit in the heap for a long time, so we sweep them out occasionally.
+    if (heap.size() > 2 * live + 64) {
+        heap.erase(remove_if(heap.begin(), heap.end(), [&shard](const Entry& entry) {
+            return !_isLive(shard, entry);
+        }), heap.end());
+        make_heap(heap.begin(), heap.end(), _after);
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_compactTimers(Shard& shard, STimerWheel<Entry>& timers) {
+    // Every item that's dequeued before its timeout leaves its entry in `timeoutTimers`, so this is what keeps that
+    // from growing with the number of items pushed during a timeout period.
+    if (timers.size() > 2 * shard.live + 64) {
+        timers.removeIf([&shard](const Entry& entry) { return !_isLive(shard, entry); });
+        shard.timersChanged = true;
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_makeReady(Shard& shard, const Entry& entry) {
+    Slot& slot = shard.slots[entry.slot];
+    auto levelIt = shard.levels.begin();
+    while (levelIt != shard.levels.end() && levelIt->priority > slot.priority) {
+        levelIt++;
+    }
+    if (levelIt == shard.levels.end() || levelIt->priority != slot.priority) {
+        levelIt = shard.levels.insert(levelIt, {slot.priority, {}, {}});
+    }
+    auto flowIt = levelIt->flows.emplace(slot.flow, Flow()).first;
+    Flow& flow = flowIt->second;
+    if (!flow.active) {
+        levelIt->rotation.push_back(flowIt);
+        flow.active = true;
+    }
+    flow.live++;
+    flow.heap.push_back({_orderByDeadline ? slot.timeout : slot.scheduled, entry.sequence, entry.slot});
+    push_heap(flow.heap.begin(), flow.heap.end(), _after);
+    slot.ready = true;
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_advance(Shard& shard, uint64_t now) {
+    if (shard.nextDue.load() > now) {
+        return;
+    }
+    shard.scheduledTimers.advance(now, [this, &shard](const Entry& entry) {
+        if (_isLive(shard, entry)) {
+            _makeReady(shard, entry);
+        }
+    });
+    shard.timeoutTimers.advance(now, [&shard](const Entry& entry) {
+        if (_isLive(shard, entry)) {
+            shard.timedOut.push_back(entry);
+        }
+    });
+    shard.timersChanged = true;
+}
+
+template<typename T>
+typename SShardedPriorityQueue<T>::Flow* SShardedPriorityQueue<T>::_nextFlow(const Shard& shard, Level& level) {
+    while (!level.rotation.empty()) {
+        auto flowIt = level.rotation.front();
+        Flow& flow = flowIt->second;
+        if (!flow.live) {
+            // Its turn has come round with nothing to take, so it's dropped until it has items again.
+            level.rotation.pop_front();
+            level.flows.erase(flowIt);
+            continue;
+        }
+        _popStale(shard, flow.heap);
+
+        // A flow starting its turn gets credit for as many items as its weight.
+        if (!flow.credit) {
+            auto weight = _flowWeights.find(flowIt->first);
+            flow.credit = weight == _flowWeights.end() ? 1 : max(weight->second, (size_t)1);
+        }
+        return &flow;
+    }
+    return nullptr;
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_updateSummary(Shard& shard) {
+    while (!shard.timedOut.empty() && !_isLive(shard, shard.timedOut.front())) {
+        shard.timedOut.pop_front();
+    }
+    shard.firstTimedOut.store(shard.timedOut.empty() ? UINT64_MAX : shard.timedOut.front().key);
+    if (shard.timersChanged) {
+        shard.nextDue.store(min(shard.scheduledTimers.nextDue(), shard.timeoutTimers.nextDue()));
+        shard.timersChanged = false;
+    }
+    for (Level& level : shard.levels) {
+        Flow* flow = _nextFlow(shard, level);
+        if (flow) {
+            const Entry& next = flow->heap.front();
+            shard.bestKey.store(next.key);
+            shard.bestSequence.store(next.sequence);
+            shard.bestFlow.store(hash<string>()(level.rotation.front()->first));
+            shard.bestPriority.store(level.priority);
+            return;
+        }
+    }
+    shard.bestPriority.store(NO_PRIORITY);
+}
+
+template<typename T>
+T SShardedPriorityQueue<T>::_remove(Shard& shard, uint32_t slotIndex) {
+    Slot& slot = shard.slots[slotIndex];
+    if (slot.ready) {
+        for (Level& level : shard.levels) {
+            if (level.priority == slot.priority) {
+                Flow& flow = level.flows.find(slot.flow)->second;
+                flow.live--;
+                _compact(shard, flow.heap, flow.live);
+                break;
+            }
+        }
+    }
+    slot.live = false;
+    shard.live--;
+    shard.freeSlots.push_back(slotIndex);
+    _size--;
+    return move(slot.item);
+}
+
+template<typename T>
+bool SShardedPriorityQueue<T>::_dequeue(Shard& shard, uint64_t now, T& item) {
+    _advance(shard, now);
+
+    // If anything has timed out, that comes first.
+    while (!shard.timedOut.empty()) {
+        Entry entry = shard.timedOut.front();
+        shard.timedOut.pop_front();
+        if (_isLive(shard, entry)) {
+            item = _remove(shard, entry.slot);
+            _compactTimers(shard, shard.scheduledTimers);
+            _updateSummary(shard);
+            return true;
+        }
+    }
+
+    // Otherwise, the next item from the flow whose turn it is at the highest priority. Everything on a level is ready.
+    for (Level& level : shard.levels) {
+        Flow* flow = _nextFlow(shard, level);
+        if (!flow) {
+            continue;
+        }
+        uint32_t slot = flow->heap.front().slot;
+        pop_heap(flow->heap.begin(), flow->heap.end(), _after);
+        flow->heap.pop_back();
+        item = _remove(shard, slot);
+        if (_flowsInUse.load()) {
+            lock_guard<mutex> lock(_serviceMutex);
+            _charge(level.rotation.front()->first);
+        }
+
+        // Once its turn is over, the flow goes to the back of the rotation.
+        if (!--flow->credit) {
+            level.rotation.push_back(level.rotation.front());
+            level.rotation.pop_front();
+        }
+        _compactTimers(shard, shard.timeoutTimers);
+        _updateSummary(shard);
+        return true;
+    }
+    _updateSummary(shard);
+    return false;
+}
+
+template<typename T>
+bool SShardedPriorityQueue<T>::_tryGet(T& item) {
+    const uint64_t now = STimeNow();
+    const size_t shardCount = _shards.size();
+
+    // Bring any shard whose timers have come due up to date, so its summary shows what's become ready or timed out.
+    // This is done even when the queue is empty, as the timers of items that have already been dequeued still need to
+    // be cleared out, or `get` would keep waking up for them.
+    for (auto& shard : _shards) {
+        if (shard->nextDue.load() <= now) {
+            lock_guard<mutex> lock(shard->shardMutex);
+            _advance(*shard, now);
+            _updateSummary(*shard);
+        }
+    }
+    if (!_size.load()) {
+        return false;
+    }
+
+    // Find the shard with the next item from the summaries: the earliest timeout that's passed, if any, or else the
+    // highest priority item from the flow that's been served least, scheduled (or due) and then pushed first.
+    size_t best = shardCount;
+    Timeout bestTimeout = UINT64_MAX;
+    for (size_t i = 0; i < shardCount; i++) {
+        Timeout timeout = _shards[i]->firstTimedOut.load();
+        if (timeout < bestTimeout) {
+            best = i;
+            bestTimeout = timeout;
+        }
+    }
+    if (best == shardCount) {
+        Priority bestPriority = NO_PRIORITY;
+        for (auto& shard : _shards) {
+            bestPriority = max(bestPriority, shard->bestPriority.load());
+        }
+        unique_lock<mutex> serviceLock(_serviceMutex, defer_lock);
+        if (bestPriority != NO_PRIORITY && _flowsInUse.load()) {
+            serviceLock.lock();
+        }
+        uint64_t bestService = UINT64_MAX;
+        uint64_t bestKey = UINT64_MAX;
+        uint64_t bestSequence = UINT64_MAX;
+        for (size_t i = 0; i < shardCount && bestPriority != NO_PRIORITY; i++) {
+            const Shard& shard = *_shards[i];
+            if (shard.bestPriority.load() != bestPriority) {
+                continue;
+            }
+            uint64_t service = serviceLock.owns_lock() ? _serviceOf(shard.bestFlow.load()) : 0;
+            uint64_t key = shard.bestKey.load();
+            uint64_t sequence = shard.bestSequence.load();
+            if (service < bestService || (service == bestService && (key < bestKey ||
+                (key == bestKey && sequence < bestSequence)))) {
+                best = i;
+                bestService = service;
+                bestKey = key;
+                bestSequence = sequence;
+            }
+        }
+    }
+    if (best != shardCount) {
+        lock_guard<mutex> lock(_shards[best]->shardMutex);
+        if (_dequeue(*_shards[best], now, item)) {
+            return true;
+        }
+    }
+
+    // Either we lost a race for that item, or nothing looked ready. Check everything, each thread starting from a
+    // different shard so they don't all pile onto the same one.
+    thread_local size_t start = hash<thread::id>()(this_thread::get_id());
+    for (size_t i = 0; i < shardCount; i++) {
+        Shard& shard = *_shards[(start + i) % shardCount];
+        if (shard.bestPriority.load() == NO_PRIORITY && shard.firstTimedOut.load() == UINT64_MAX) {
+            continue;
+        }
+        lock_guard<mutex> lock(shard.shardMutex);
+        if (_dequeue(shard, now, item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template<typename T>
+uint64_t SShardedPriorityQueue<T>::_serviceOf(size_t flowHash) {
+    auto it = _flowService.find(flowHash);
+    return it == _flowService.end() ? _virtualTime : max(it->second, _virtualTime);
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::_charge(const string& flow) {
+    const size_t flowHash = hash<string>()(flow);
+    _virtualTime = _serviceOf(flowHash);
+    auto weight = _flowWeights.find(flow);
+    _flowService[flowHash] = _virtualTime + SERVICE_PER_ITEM / (weight == _flowWeights.end() ? 1 :
+                                                                max(weight->second, (size_t)1));
+    if (_flowService.size() > MAX_FLOW_SERVICE) {
+        for (auto it = _flowService.begin(); it != _flowService.end();) {
+            it = it->second <= _virtualTime ? _flowService.erase(it) : next(it);
+        }
+    }
+}
+
+template<typename T>
+uint64_t SShardedPriorityQueue<T>::_nextDue() {
+    uint64_t nextDue = UINT64_MAX;
+    for (auto& shard : _shards) {
+        nextDue = min(nextDue, shard->nextDue.load());
+    }
+    return nextDue;
+}
+
+template<typename T>
+T SShardedPriorityQueue<T>::get(uint64_t waitUS) {
+    T item;
+    if (_tryGet(item)) {
+        _endFunction(item);
+        return item;
+    }
+
+    // Nothing's ready, so we'll wait. We count ourselves as sleeping *before* we look again, so any push that we don't
+    // see will see us, and wake us up.
+    auto timeout = chrono::steady_clock::now() + chrono::microseconds(waitUS);
+    unique_lock<mutex> sleepLock(_sleepMutex);
+    _sleepers++;
+    while (true) {
+        if (_tryGet(item)) {
+            _sleepers--;
+            sleepLock.unlock();
+            _endFunction(item);
+            return item;
+        }
+        if (waitUS && chrono::steady_clock::now() > timeout) {
+            _sleepers--;
+            throw timeout_error();
+        }
+
+        // Wake up when the next timer is due, if that's before we'd otherwise give up. A push wakes us too, in case
+        // it's due sooner.
+        const uint64_t nextDue = _nextDue();
+        const uint64_t now = STimeNow();
+        if (nextDue <= now) {
+            continue;
+        }
+        if (nextDue != UINT64_MAX) {
+            auto due = chrono::steady_clock::now() + chrono::microseconds(nextDue - now);
+            _wakeCondition.wait_until(sleepLock, waitUS ? min(due, timeout) : due);
+        } else if (waitUS) {
+            _wakeCondition.wait_until(sleepLock, timeout);
+        } else {
+            _wakeCondition.wait(sleepLock);
+        }
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::push(T&& item, Priority priority, Scheduled scheduled, Timeout timeout,
+                                    const string& flow) {
+    _startFunction(item);
+    if (!flow.empty() && !_flowsInUse.load()) {
+        _flowsInUse.store(true);
+    }
+    const uint64_t sequence = _nextSequence.fetch_add(1);
+    Shard& shard = *_shards[sequence % _shards.size()];
+    {
+        lock_guard<mutex> lock(shard.shardMutex);
+        uint32_t slotIndex;
+        if (shard.freeSlots.empty()) {
+            slotIndex = (uint32_t)shard.slots.size();
+            shard.slots.push_back({move(item), priority, scheduled, timeout, sequence, flow, true, false});
+        } else {
+            slotIndex = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+            shard.slots[slotIndex] = {move(item), priority, scheduled, timeout, sequence, flow, true, false};
+        }
+
+        // Anything scheduled in the future waits on a timer until it's ready.
+        const Entry entry = {scheduled, sequence, slotIndex};
+        if (scheduled > STimeNow()) {
+            shard.scheduledTimers.insert(scheduled, Entry(entry));
+        } else {
+            _makeReady(shard, entry);
+        }
+        shard.timeoutTimers.insert(timeout, {timeout, sequence, slotIndex});
+        shard.timersChanged = true;
+        shard.live++;
+        _size++;
+        _updateSummary(shard);
+    }
+
+    if (_sleepers.load()) {
+        lock_guard<mutex> lock(_sleepMutex);
+        _wakeCondition.notify_one();
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::clear() {
+    for (auto& shard : _shards) {
+        lock_guard<mutex> lock(shard->shardMutex);
+        _size -= shard->live;
+        shard->slots.clear();
+        shard->freeSlots.clear();
+        shard->levels.clear();
+        shard->scheduledTimers.clear();
+        shard->timeoutTimers.clear();
+        shard->timedOut.clear();
+        shard->timersChanged = true;
+        shard->live = 0;
+        _updateSummary(*shard);
+    }
+}
+
+template<typename T>
+void SShardedPriorityQueue<T>::forEach(function<void(const T& item)> callback) {
+    for (auto& shard : _shards) {
+        lock_guard<mutex> lock(shard->shardMutex);
+        for (const Slot& slot : shard->slots) {
+            if (slot.live) {
+                callback(slot.item);
+            }
+        }
+    }
+}
+
+template<typename T>
+size_t SShardedPriorityQueue<T>::eraseScheduledAfter(Scheduled scheduled) {
+    size_t erased = 0;
+    for (auto& shard : _shards) {
+        lock_guard<mutex> lock(shard->shardMutex);
+        for (uint32_t i = 0; i < shard->slots.size(); i++) {
+            if (shard->slots[i].live && shard->slots[i].scheduled >= scheduled) {
+                _remove(*shard, i);
+                erased++;
+            }
+        }
+        _compactTimers(*shard, shard->scheduledTimers);
+        _compactTimers(*shard, shard->timeoutTimers);
+        _updateSummary(*shard);
+    }
+    return erased;
+}
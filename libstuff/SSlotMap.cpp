@@ -0,0 +1,28 @@
+#include <libstuff/libstuff.h>
+#include "SSlotMap.h"
+
+uint64_t SSlotIDs::acquire() {
+    lock_guard<mutex> lock(_mutex);
+    uint32_t slot;
+    if (_freeSlots.empty()) {
+        slot = (uint32_t)_generations.size();
+        _generations.push_back(0);
+    } else {
+        slot = _freeSlots.back();
+        _freeSlots.pop_back();
+    }
+
+    // Generations start at 1, so no ID is ever 0, and wrap before the top bit so IDs are always positive as int64_t.
+    uint32_t generation = ++_generations[slot];
+    if (generation > INT32_MAX) {
+        generation = _generations[slot] = 1;
+    }
+    return ((uint64_t)generation << 32) | slot;
+}
+
+void SSlotIDs::release(uint64_t id) {
+    lock_guard<mutex> lock(_mutex);
+    uint32_t slot = (uint32_t)id;
+    SASSERT(slot < _generations.size() && _generations[slot] == (uint32_t)(id >> 32));
+    _freeSlots.push_back(slot);
+}
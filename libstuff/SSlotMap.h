@@ -0,0 +1,118 @@
+#pragma once
+
+// Hands out generational IDs. The low 32 bits of each ID are a slot number, which is reused once the ID holding it is
+// released, so slot numbers stay as small as the largest number of IDs ever in use at once. The high bits count how
+// many times that slot has been handed out, so a released ID doesn't compare equal to a later one that reuses its
+// slot. Safe to use from multiple threads.
+class SSlotIDs {
+  public:
+    uint64_t acquire();
+    void release(uint64_t id);
+
+  private:
+    mutex _mutex;
+
+    // The generation most recently handed out for each slot, and the slots that are free to reuse.
+    vector<uint32_t> _generations;
+    vector<uint32_t> _freeSlots;
+};
+
+// A map from IDs handed out by SSlotIDs to values. Lookup, insertion and removal are all constant time: each slot
+// number indexes directly into a table of positions, and values are stored contiguously so iterating is just walking
+// an array. Removing a value moves the last value into its place, so removal changes the iteration order and must not
+// be done while iterating. Not synchronized.
+template <typename T>
+class SSlotMap {
+  public:
+    typedef typename vector<T>::iterator iterator;
+    typedef typename vector<T>::const_iterator const_iterator;
+
+    // Adds `value` for `id`. If anything is already stored in the same slot (which means it wasn't removed when its ID
+    // was released), it's replaced. Returns a reference to the stored value, which is valid until the next insertion
+    // or removal.
+    T& insert(uint64_t id, T value);
+
+    // Returns the value for `id`, or nullptr if it's not present. A stale ID whose slot has been reused isn't found.
+    T* find(uint64_t id);
+
+    // Removes the value for `id`. Returns false if it wasn't present.
+    bool erase(uint64_t id);
+
+    // Removes everything.
+    void clear();
+
+    size_t size() const { return _values.size(); }
+    bool empty() const { return _values.empty(); }
+    T& front() { return _values.front(); }
+
+    // Iterates over all values, in no particular order.
+    iterator begin() { return _values.begin(); }
+    iterator end() { return _values.end(); }
+    const_iterator begin() const { return _values.begin(); }
+    const_iterator end() const { return _values.end(); }
+
+  private:
+    // The values and the ID each is stored under, in matching order.
+    vector<T> _values;
+    vector<uint64_t> _ids;
+
+    // For each slot number, one more than the position of its value in `_values`, or 0 if it has none.
+    vector<size_t> _positions;
+};
+
+template <typename T>
+T& SSlotMap<T>::insert(uint64_t id, T value) {
+    uint32_t slot = (uint32_t)id;
+    if (slot >= _positions.size()) {
+        _positions.resize(slot + 1, 0);
+    }
+    if (_positions[slot]) {
+        size_t position = _positions[slot] - 1;
+        SWARN("Replacing ID " << _ids[position] << " with " << id << " in slot " << slot << ".");
+        _values[position] = move(value);
+        _ids[position] = id;
+        return _values[position];
+    }
+    _values.push_back(move(value));
+    _ids.push_back(id);
+    _positions[slot] = _values.size();
+    return _values.back();
+}
+
+template <typename T>
+T* SSlotMap<T>::find(uint64_t id) {
+    uint32_t slot = (uint32_t)id;
+    if (slot >= _positions.size() || !_positions[slot]) {
+        return nullptr;
+    }
+    size_t position = _positions[slot] - 1;
+    return _ids[position] == id ? &_values[position] : nullptr;
+}
+
+template <typename T>
+bool SSlotMap<T>::erase(uint64_t id) {
+    uint32_t slot = (uint32_t)id;
+    if (slot >= _positions.size() || !_positions[slot] || _ids[_positions[slot] - 1] != id) {
+        return false;
+    }
+
+    // Move the last value into the hole and point its slot at the new position.
+    size_t position = _positions[slot] - 1;
+    size_t last = _values.size() - 1;
+    if (position != last) {
+        _values[position] = move(_values[last]);
+        _ids[position] = _ids[last];
+        _positions[(uint32_t)_ids[position]] = position + 1;
+    }
+    _values.pop_back();
+    _ids.pop_back();
+    _positions[slot] = 0;
+    return true;
+}
+
+template <typename T>
+void SSlotMap<T>::clear() {
+    _values.clear();
+    _ids.clear();
+    _positions.clear();
+}
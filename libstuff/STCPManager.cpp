@@ -1,13 +1,19 @@
 #include "libstuff.h"
 
-atomic<uint64_t> STCPManager::Socket::socketCount(1);
+SSlotIDs STCPManager::Socket::socketIDs;
 
 STCPManager::~STCPManager() {
     SASSERTWARN(socketList.empty());
 }
 
 void STCPManager::prePoll(fd_map& fdm) {
-    // Add all the sockets
+    // If our sockets are registered with our epoll set, that's all we need to wait on.
+    if (_epoll.valid()) {
+        SFDset(fdm, _epoll.fd(), SREADEVTS);
+        return;
+    }
+
+    // Otherwise, add all the sockets
     for (Socket* socket : socketList) {
         // Make sure it's not closed
         if (socket->state.load() != Socket::CLOSED) {
@@ -16,65 +22,52 @@ void STCPManager::prePoll(fd_map& fdm) {
                 SWARN("Invalid FD number("
                       << socket->s << "), we're probably about to corrupt stack memory. FD_SETSIZE=" << FD_SETSIZE);
             }
-            // Add this socket. First, we always want to read, and we always want to learn of exceptions.
-            SFDset(fdm, socket->s, SREADEVTS);
-
-            // However, we only want to write in some states. No matter what, we want to send if we're not yet
-            // connected. And if we're not using SSL, then we want to send only when we have something buffered for
-            // sending. But if we *are* using SSL, it's a bit more complex. If we've completed the handshake, then we
-            // only want to send when we have data. But if we're inside the handshake, leave it up to the SSL engine
-            // to decide if it wants to send.
-            if (socket->state.load() == Socket::CONNECTING) {
-                // We haven't yet connected -- send regardless of SSL
-                SFDset(fdm, socket->s, SWRITEEVTS);
-            } else if (!socket->ssl) {
-                // No SSL, just send if we have anything buffered
-                if (!socket->sendBufferEmpty()) {
-                    SFDset(fdm, socket->s, SWRITEEVTS);
-                }
-            } else {
-                // Have we completed the handshake?
-                SASSERT(socket->ssl);
-                SSSLState* sslState = socket->ssl;
-                if (sslState->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
-                    // Handshake done -- send if we have anything buffered
-                    if (!socket->sendBufferEmpty()) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
-                } else {
-                    // Handshake isn't done -- send if SSL wants to
-                    bool write;
-                    switch (sslState->ssl.state) {
-                    case MBEDTLS_SSL_HELLO_REQUEST:
-                    case MBEDTLS_SSL_CLIENT_HELLO:
-                    case MBEDTLS_SSL_CLIENT_CERTIFICATE:
-                    case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
-                    case MBEDTLS_SSL_CERTIFICATE_VERIFY:
-                    case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
-                    case MBEDTLS_SSL_CLIENT_FINISHED:
-                        // In these cases, SSL is waiting to write already.
-                        // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
-                        write = true;
-                        break;
-                    default:
-                        write = false;
-                        break;
-                    }
-                    if (write) {
-                        SFDset(fdm, socket->s, SWRITEEVTS);
-                    }
-                }
+            // If we're still waiting for DNS, there's nothing to do with the socket itself yet.
+            if (socket->lookup) {
+                SFDset(fdm, socket->lookup->fd(), SREADEVTS);
+                continue;
             }
+            SFDset(fdm, socket->s, socket->_wantedEvents());
         }
     }
 }
 
 void STCPManager::postPoll(fd_map& fdm) {
+    // Find out which of our sockets are ready. This adds them to `fdm`, so from here on we can treat them exactly as
+    // though they'd been polled directly.
+    if (_epoll.valid() && SFDAnySet(fdm, _epoll.fd(), SREADEVTS)) {
+        if (_epoll.wait(fdm, 0) < 0) {
+            SWARN("epoll_wait failed with response '" << strerror(errno) << "' (#" << errno << "), ignoring");
+        }
+    }
+
     // Walk across the sockets
     for (Socket* socket : socketList) {
         // Update this socket
-        switch (socket->state.load()) {
+        const Socket::State previousState = socket->state.load();
+        switch (previousState) {
         case Socket::CONNECTING: {
+            // If we were waiting for DNS, start connecting once it's answered.
+            if (socket->lookup) {
+                if (!socket->lookup->done()) {
+                    break;
+                }
+                in_addr_t ip = socket->lookup->ip();
+                if (_epoll.valid()) {
+                    _epoll.remove(socket->lookup->fd());
+                }
+                socket->lookup = nullptr;
+                if (ip == INADDR_NONE || !S_connect(socket->s, ip, socket->lookupPort)) {
+                    SDEBUG("Connect to '" << socket->addr << "' failed, closing.");
+                    socket->state.store(Socket::CLOSED);
+                    socket->connectFailure = true;
+                }
+
+                // Now we wait on the socket itself.
+                socket->_watch();
+                break;
+            }
+
             // See if it connected or failed
             if (!SFDAnySet(fdm, socket->s, SWRITEEVTS | POLLHUP | POLLERR)) {
                 // Keep waiting for asynchronous connect result
@@ -196,6 +189,11 @@ void STCPManager::postPoll(fd_map& fdm) {
         default:
             SERROR("Unknown socket state");
         }
+
+        // Sending and receiving keep the socket's registration up to date, but changing state doesn't.
+        if (socket->state.load() != previousState) {
+            socket->_watch();
+        }
     }
 }
 
@@ -205,24 +203,59 @@ void STCPManager::shutdownSocket(Socket* socket, int how) {
     SDEBUG("Shutting down socket '" << socket->addr << "' (" << how << ")");
     ::shutdown(socket->s, how);
     socket->state.store(Socket::SHUTTINGDOWN);
+    socket->_watch();
 }
 
 void STCPManager::closeSocket(Socket* socket) {
     // Clean up this socket
     SASSERT(socket);
     SDEBUG("Closing socket '" << socket->addr << "'");
-    socketList.remove(socket);
+    removeSocket(socket);
 
     delete socket;
 }
 
+void STCPManager::addSocket(Socket* socket) {
+    socketList.insert(socket->id, socket);
+    if (_epoll.valid()) {
+        lock_guard<decltype(socket->sendRecvMutex)> lock(socket->sendRecvMutex);
+        socket->_epoll = &_epoll;
+        socket->_registeredEvents = 0;
+        socket->_watch();
+
+        // If it's waiting for DNS, we wait for that instead.
+        if (socket->lookup && !_epoll.set(socket->lookup->fd(), SREADEVTS)) {
+            SWARN("Couldn't wait for DNS lookup for '" << socket->lookup->domain << "': '" << strerror(errno) << "' (#"
+                  << errno << ").");
+        }
+    }
+}
+
+void STCPManager::removeSocket(Socket* socket) {
+    socketList.erase(socket->id);
+    lock_guard<decltype(socket->sendRecvMutex)> lock(socket->sendRecvMutex);
+    if (socket->_epoll) {
+        if (socket->_registeredEvents) {
+            socket->_epoll->remove(socket->s);
+        }
+        if (socket->lookup) {
+            socket->_epoll->remove(socket->lookup->fd());
+        }
+        socket->_epoll = nullptr;
+        socket->_registeredEvents = 0;
+    }
+}
+
 STCPManager::Socket::Socket(int sock, STCPManager::Socket::State state_, SX509* x509)
   : s(sock), addr{}, state(state_), connectFailure(false), openTime(STimeNow()), lastSendTime(openTime),
-    lastRecvTime(openTime), ssl(nullptr), data(nullptr), id(STCPManager::Socket::socketCount++), _x509(x509),
-    sentBytes(0), recvBytes(0)
+    lastRecvTime(openTime), ssl(nullptr), data(nullptr), id(STCPManager::Socket::socketIDs.acquire()), lookupPort(0),
+    _epoll(nullptr), _registeredEvents(0), sendChunkOffset(0), _x509(x509), sentBytes(0), recvBytes(0)
 { }
 
 STCPManager::Socket::~Socket() {
+    if (_epoll && _registeredEvents) {
+        _epoll->remove(s);
+    }
     ::close(s);
     if (ssl) {
         SSSLClose(ssl);
@@ -230,26 +263,46 @@ STCPManager::Socket::~Socket() {
     if (_x509) {
         SX509Close(_x509);
     }
+    socketIDs.release(id);
 }
 
 STCPManager::Socket* STCPManager::openSocket(const string& host, SX509* x509, recursive_mutex* listMutexPtr) {
     // Try to open the socket
     SASSERT(SHostIsValid(host));
-    int s = S_socket(host, true, false, false);
-    if (s < 0) {
+    string domain;
+    uint16_t port = 0;
+    SParseHost(host, domain, port);
+    shared_ptr<SDNSResolver::Lookup> lookup = SDNSResolver::resolve(domain);
+
+    // The resolver can finish the lookup at any moment, so we check once, and stick with the answer. If it finishes
+    // after this, `postPoll` connects the socket.
+    const bool resolved = lookup->done();
+    if (resolved && lookup->ip() == INADDR_NONE) {
+        return 0;
+    }
+    int s = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, IPPROTO_TCP);
+    if (s < 0 || (resolved && !S_connect(s, lookup->ip(), port))) {
+        SWARN("Failed to open TCP socket '" << host << "' (errno=" << errno << " '" << strerror(errno) << "')");
+        if (s >= 0) {
+            ::close(s);
+        }
         return 0;
     }
 
-    // Create a new socket
+    // Create a new socket. If we don't know where to connect it yet, `postPoll` does that once we do.
     Socket* socket = new Socket(s, Socket::CONNECTING, x509);
-    socket->ssl = x509 ? SSSLOpen(socket->s, x509) : 0;
+    if (!resolved) {
+        socket->lookup = move(lookup);
+        socket->lookupPort = port;
+    }
+    socket->ssl = x509 ? SSSLOpen(socket->s, x509, host) : 0;
     SASSERT(!x509 || socket->ssl);
 
     if (listMutexPtr) {
         lock_guard<recursive_mutex> lock(*listMutexPtr);
-        socketList.push_back(socket);
+        addSocket(socket);
     } else {
-        socketList.push_back(socket);
+        addSocket(socket);
     }
     return socket;
 }
@@ -270,28 +323,56 @@ uint64_t STCPManager::Socket::getSentBytes() {
     return sentBytes;
 }
 
+size_t STCPManager::Socket::_sendSize() {
+    size_t size = sendBuffer.size();
+    for (const string& chunk : sendChunks) {
+        size += chunk.size();
+    }
+    return size - sendChunkOffset;
+}
+
 bool STCPManager::Socket::send() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
+
+    // Until we've connected (which may be waiting on DNS), there's nowhere to send anything. `postPoll` sends whatever
+    // is buffered as soon as we are.
+    if (state.load() == Socket::CONNECTING) {
+        return true;
+    }
+
     // Send data
     bool result = false;
-    size_t oldSize = sendBuffer.size();
+    size_t oldSize = _sendSize();
     if (ssl) {
+        // SSL has to encrypt everything into its own buffers anyway, so there's nothing to gain by keeping chunks
+        // separate.
+        for (const string& chunk : sendChunks) {
+            sendBuffer.append(chunk.data() + sendChunkOffset, chunk.size() - sendChunkOffset);
+            sendChunkOffset = 0;
+        }
+        sendChunks.clear();
         result = SSSLSendConsume(ssl, sendBuffer);
     } else if (s > 0) {
-        result = S_sendconsume(s, sendBuffer);
+        result = sendChunks.empty() ? S_sendconsume(s, sendBuffer) : S_sendconsume(s, sendBuffer, sendChunks, sendChunkOffset);
     }
-    sentBytes += (oldSize - sendBuffer.size());
+    sentBytes += (oldSize - _sendSize());
     lastSendTime = STimeNow();
+    _watch();
     return result;
 }
 
 bool STCPManager::Socket::send(const string& buffer) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
 
-    // If the socket's in a valid state for sending, append to the sendBuffer, otherwise warn
+    // If the socket's in a valid state for sending, append to the sendBuffer, otherwise warn. If there are chunks
+    // waiting, `sendBuffer` goes out before them, so this has to wait behind them as a chunk of its own.
     if (state.load() < Socket::State::SHUTTINGDOWN) {
-        sendBuffer += buffer;
-    } else if (!sendBuffer.empty()) {
+        if (sendChunks.empty()) {
+            sendBuffer += buffer;
+        } else {
+            sendChunks.push_back(buffer);
+        }
+    } else if (!sendBuffer.empty() || !sendChunks.empty()) {
         SWARN("Not appending to sendBuffer in socket state " << state.load() << ", tried to send: " << buffer);
     }
 
@@ -299,19 +380,41 @@ bool STCPManager::Socket::send(const string& buffer) {
     return send();
 }
 
+bool STCPManager::Socket::send(list<string>&& buffers) {
+    lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
+
+    // If the socket's in a valid state for sending, queue the buffers, otherwise warn
+    if (state.load() < Socket::State::SHUTTINGDOWN) {
+        sendChunks.splice(sendChunks.end(), buffers);
+    } else if (!sendBuffer.empty() || !sendChunks.empty()) {
+        SWARN("Not appending to sendBuffer in socket state " << state.load() << ", tried to send "
+              << buffers.size() << " buffers.");
+    }
+
+    // Send anything we've got.
+    return send();
+}
+
 bool STCPManager::Socket::sendBufferEmpty() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    return sendBuffer.empty();
+    return sendBuffer.empty() && sendChunks.empty();
 }
 
 string STCPManager::Socket::sendBufferCopy() {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
-    return string(sendBuffer.c_str(), sendBuffer.size());
+    string copy(sendBuffer.c_str(), sendBuffer.size());
+    for (const string& chunk : sendChunks) {
+        copy += chunk.substr(&chunk == &sendChunks.front() ? sendChunkOffset : 0);
+    }
+    return copy;
 }
 
 void STCPManager::Socket::setSendBuffer(const string& buffer) {
     lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
     sendBuffer = buffer;
+    sendChunks.clear();
+    sendChunkOffset = 0;
+    _watch();
 }
 
 bool STCPManager::Socket::recv() {
@@ -331,5 +434,74 @@ bool STCPManager::Socket::recv() {
         recvBytes += (recvBuffer.size() - oldSize);
         lastRecvTime = STimeNow();
     }
+
+    // SSL may want to send something now.
+    if (ssl) {
+        _watch();
+    }
     return result;
 }
+
+short STCPManager::Socket::_wantedEvents() {
+    if (state.load() == Socket::CLOSED || lookup) {
+        return 0;
+    }
+
+    // First, we always want to read, and we always want to learn of exceptions.
+    short events = SREADEVTS;
+
+    // However, we only want to write in some states. No matter what, we want to send if we're not yet connected. And
+    // if we're not using SSL, then we want to send only when we have something buffered for sending. But if we *are*
+    // using SSL, it's a bit more complex. If we've completed the handshake, then we only want to send when we have
+    // data. But if we're inside the handshake, leave it up to the SSL engine to decide if it wants to send.
+    if (state.load() == Socket::CONNECTING) {
+        // We haven't yet connected -- send regardless of SSL
+        events |= SWRITEEVTS;
+    } else if (!ssl) {
+        // No SSL, just send if we have anything buffered
+        if (!sendBufferEmpty()) {
+            events |= SWRITEEVTS;
+        }
+    } else if (ssl->ssl.state == MBEDTLS_SSL_HANDSHAKE_OVER) {
+        // Handshake done -- send if we have anything buffered
+        if (!sendBufferEmpty()) {
+            events |= SWRITEEVTS;
+        }
+    } else {
+        // Handshake isn't done -- send if SSL wants to
+        switch (ssl->ssl.state) {
+        case MBEDTLS_SSL_HELLO_REQUEST:
+        case MBEDTLS_SSL_CLIENT_HELLO:
+        case MBEDTLS_SSL_CLIENT_CERTIFICATE:
+        case MBEDTLS_SSL_CLIENT_KEY_EXCHANGE:
+        case MBEDTLS_SSL_CERTIFICATE_VERIFY:
+        case MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC:
+        case MBEDTLS_SSL_CLIENT_FINISHED:
+            // In these cases, SSL is waiting to write already.
+            // @see https://www.mail-archive.com/list@xyssl.org/msg00041.html
+            events |= SWRITEEVTS;
+            break;
+        default:
+            break;
+        }
+    }
+    return events;
+}
+
+void STCPManager::Socket::_watch() {
+    lock_guard<decltype(sendRecvMutex)> lock(sendRecvMutex);
+    if (!_epoll) {
+        return;
+    }
+    short events = _wantedEvents();
+    if (events == _registeredEvents) {
+        return;
+    }
+    if (!events) {
+        _epoll->remove(s);
+    } else if (!_epoll->set(s, events)) {
+        SWARN("Couldn't wait on socket to '" << addr << "': '" << strerror(errno) << "' (#" << errno << ").");
+        events = 0;
+    }
+    _registeredEvents = events;
+}
@@ -13,6 +13,10 @@ struct STCPManager {
         int s;
         sockaddr_in addr;
         SFastBuffer recvBuffer;
+
+        // Remembers how much of the message at the front of `recvBuffer` has already been parsed, so it isn't parsed
+        // again each time more of it arrives. Pass this to `SData::deserialize` along with `recvBuffer`.
+        SHTTPParser recvParser;
         atomic<State> state;
         bool connectFailure;
         uint64_t openTime;
@@ -22,6 +26,10 @@ struct STCPManager {
         void* data;
         bool send();
         bool send(const string& buffer);
+
+        // Queues each of `buffers` to be sent, in order, after anything already queued, taking ownership of them
+        // rather than copying them into the send buffer. They're written with a single scatter-gather call.
+        bool send(list<string>&& buffers);
         bool recv();
         uint64_t id;
         string logString;
@@ -34,15 +42,41 @@ struct STCPManager {
         uint64_t getRecvBytes();
         uint64_t getSentBytes();
 
+        // While the host this socket is connecting to is being resolved, the lookup, and the port to connect to once
+        // it's done. The socket stays CONNECTING, and `prePoll` watches the lookup rather than the socket, until then.
+        shared_ptr<SDNSResolver::Lookup> lookup;
+        uint16_t lookupPort;
+
       private:
-        static atomic<uint64_t> socketCount;
+        friend struct STCPManager;
+
+        // Socket IDs are generational, so that an ID can be looked up in an SSlotMap in constant time.
+        static SSlotIDs socketIDs;
         recursive_mutex sendRecvMutex;
 
+        // The epoll set of the manager that owns this socket, if it uses one, and what the socket's registered there
+        // for. `_watch` updates the registration to match what we're waiting for now, and is called whenever that
+        // might have changed: after sending and receiving, and when our state changes.
+        SEpoll* _epoll;
+        short _registeredEvents;
+        void _watch();
+
+        // Returns the events we're waiting for in our current state, or 0 if we aren't waiting on the socket at all.
+        short _wantedEvents();
+
         // This is private because it's used by our synchronized send() functions. This requires it to only
         // be accessed through the (also synchronized) wrapper functions above.
         // NOTE: Currently there's no synchronization around `recvBuffer`. It can only be accessed by one thread.
         SFastBuffer sendBuffer;
 
+        // Buffers passed to `send(list<string>&&)` that are waiting to go out after `sendBuffer`, and how much of the
+        // first one has already been sent.
+        list<string> sendChunks;
+        size_t sendChunkOffset;
+
+        // Returns the number of bytes waiting to be sent.
+        size_t _sendSize();
+
         // Each socket owns it's own SX509 object to avoid thread-safety issues reading/writing the same certificate in
         // the underlying ssl code. Once assigned, the socket owns this object for it's lifetime and will delete it
         // upon destruction.
@@ -59,7 +93,8 @@ struct STCPManager {
     void prePoll(fd_map& fdm);
     void postPoll(fd_map& fdm);
 
-    // Opens outgoing socket
+    // Opens outgoing socket. This never waits for DNS: if the host's address isn't already known, the socket is
+    // returned CONNECTING, and connects once it's resolved. Returns null if the host is already known not to resolve.
     Socket* openSocket(const string& host, SX509* x509 = nullptr, recursive_mutex* listMutexPtr = nullptr);
 
     // Gracefully shuts down a socket
@@ -68,6 +103,16 @@ struct STCPManager {
     // Hard terminate a socket
     void closeSocket(Socket* socket);
 
-    // Attributes
-    list<Socket*> socketList;
+    // Adds a socket to `socketList` and starts waiting on it, or stops and removes it, without closing it. Use these
+    // to move a socket from one manager to another.
+    void addSocket(Socket* socket);
+    void removeSocket(Socket* socket);
+
+    // Attributes. Sockets are keyed by their `id`.
+    SSlotMap<Socket*> socketList;
+
+  private:
+    // Our sockets are registered here, unless `SEpoll::enabled` was false when we were created, in which case
+    // `prePoll` adds every one of them to the `fd_map` instead.
+    SEpoll _epoll;
 };
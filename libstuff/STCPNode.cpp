@@ -104,15 +104,14 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
     // Accept any new peers
     Socket* socket = nullptr;
     while ((socket = acceptSocket()))
-        acceptedSocketList.push_back(socket);
+        acceptedSocketList.insert(socket->id, socket);
 
-    // Process the incoming sockets
-    list<Socket*>::iterator nextSocketIt = acceptedSocketList.begin();
-    while (nextSocketIt != acceptedSocketList.end()) {
+    // Process the incoming sockets. Removing a socket from `acceptedSocketList` reorders it, so we collect the IDs of
+    // the ones we're done with and remove them afterwards.
+    list<uint64_t> finishedSocketIDs;
+    for (Socket* socket : acceptedSocketList) {
         // See if we've logged in (we know we're already connected because
         // we're accepting an inbound connection)
-        list<Socket*>::iterator socketIt = nextSocketIt++;
-        Socket* socket = *socketIt;
         try {
             // Verify it's still alive
             if (socket->state.load() != Socket::CONNECTED)
@@ -120,7 +119,7 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
 
             // Still alive; try to login
             SData message;
-            int messageSize = message.deserialize(socket->recvBuffer);
+            int messageSize = message.deserialize(socket->recvBuffer, socket->recvParser);
             if (messageSize) {
                 // What is it?
                 socket->recvBuffer.consumeFront(messageSize);
@@ -137,7 +136,7 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                                 PINFO("Attaching incoming socket");
                                 peer->socket = socket;
                                 peer->failedConnections = 0;
-                                acceptedSocketList.erase(socketIt);
+                                finishedSocketIDs.push_back(socket->id);
                                 foundIt = true;
 
                                 // Send our own PING back so we can estimate latency
@@ -168,10 +167,13 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                 SWARN("Incoming connection failed from '" << socket->addr << "' (" << e.what() << "), recv='"
                       << socket->recvBuffer << "', send='" << socket->sendBufferCopy() << "'");
             }
+            finishedSocketIDs.push_back(socket->id);
             closeSocket(socket);
-            acceptedSocketList.erase(socketIt);
         }
     }
+    for (uint64_t socketID : finishedSocketIDs) {
+        acceptedSocketList.erase(socketID);
+    }
 
     // Try to establish connections with peers and process messages
     for (Peer* peer : peerList) {
@@ -201,7 +203,7 @@ void STCPNode::postPoll(fd_map& fdm, uint64_t& nextActivity) {
                     }
 
                     // Process all messages
-                    while (AutoTimerTime(_deserializeTimer), (messageSize = message.deserialize(peer->socket->recvBuffer))) {
+                    while (AutoTimerTime(_deserializeTimer), (messageSize = message.deserialize(peer->socket->recvBuffer, peer->socket->recvParser))) {
                         // Which message?
                         {
                             AutoTimerTime consumeTime(_sConsumeFrontTimer);
@@ -152,7 +152,7 @@ struct STCPNode : public STCPServer {
     string name;
     uint64_t recvTimeout;
     const vector<Peer*> peerList;
-    list<Socket*> acceptedSocketList;
+    SSlotMap<Socket*> acceptedSocketList;
 
     // Called when we first establish a connection with a new peer
     virtual void _onConnect(Peer* peer) = 0;
@@ -62,7 +62,7 @@ STCPManager::Socket* STCPServer::acceptSocket(Port*& portOut) {
             SDEBUG("Accepting socket from '" << addr << "' on port '" << port.host << "'");
             socket = new Socket(s, Socket::CONNECTED);
             socket->addr = addr;
-            socketList.push_back(socket);
+            addSocket(socket);
 
             // Try to read immediately
             S_recvappend(socket->s, socket->recvBuffer);
@@ -0,0 +1,129 @@
+#include <libstuff/libstuff.h>
+#include "SThreadPlacement.h"
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+
+map<string, SThreadPlacement::Placement> SThreadPlacement::_policy;
+STable SThreadPlacement::_placements;
+mutex SThreadPlacement::_placementsMutex;
+
+set<int> SThreadPlacement::parseCPUList(const string& list) {
+    set<int> cpus;
+    for (const string& range : SParseList(STrim(list))) {
+        size_t dash = range.find('-');
+        const string first = range.substr(0, dash);
+        const string last = dash == string::npos ? first : range.substr(dash + 1);
+        if (first.empty() || last.empty() || first.find_first_not_of("0123456789") != string::npos ||
+            last.find_first_not_of("0123456789") != string::npos) {
+            return {};
+        }
+        const int from = SToInt(first);
+        const int to = SToInt(last);
+        if (from > to || to >= CPU_SETSIZE) {
+            return {};
+        }
+        for (int cpu = from; cpu <= to; cpu++) {
+            cpus.insert(cpu);
+        }
+    }
+    return cpus;
+}
+
+string SThreadPlacement::composeCPUList(const set<int>& cpus) {
+    // Collapse consecutive CPUs into ranges.
+    list<string> ranges;
+    for (auto it = cpus.begin(); it != cpus.end();) {
+        const int first = *it;
+        int last = first;
+        while (++it != cpus.end() && *it == last + 1) {
+            last++;
+        }
+        ranges.push_back(first == last ? to_string(first) : to_string(first) + "-" + to_string(last));
+    }
+    return SComposeList(ranges, ",");
+}
+
+void SThreadPlacement::configure(const string& policy) {
+    _policy.clear();
+    for (const string& entry : SParseList(policy, ';')) {
+        const size_t colon = entry.find(':');
+        if (colon == string::npos) {
+            SWARN("Ignoring thread placement '" << entry << "', expected 'role:placement'.");
+            continue;
+        }
+        const string role = STrim(entry.substr(0, colon));
+        const string placement = STrim(entry.substr(colon + 1));
+        Placement result = {{}, -1};
+        const string node = SStartsWith(placement, "node") ? placement.substr(4) : "";
+        if (!node.empty() && node.find_first_not_of("0123456789") == string::npos) {
+            result.node = SToInt(node);
+            result.cpus = parseCPUList(SFileLoad("/sys/devices/system/node/node" + node + "/cpulist"));
+        } else {
+            result.cpus = parseCPUList(placement);
+        }
+        if (role.empty() || result.cpus.empty()) {
+            SWARN("Ignoring thread placement '" << entry << "', no CPUs found for '" << placement << "'.");
+            continue;
+        }
+        SINFO("Placing '" << role << "' threads on CPUs " << composeCPUList(result.cpus)
+              << (result.node >= 0 ? " (NUMA node " + to_string(result.node) + ")" : ""));
+        _policy[role] = move(result);
+    }
+}
+
+void SThreadPlacement::apply(const string& threadName) {
+    // The role is the thread name without its number.
+    const string role = threadName.substr(0, threadName.find_last_not_of("0123456789") + 1);
+    auto it = _policy.find(role);
+    if (it == _policy.end()) {
+        return;
+    }
+    const Placement& placement = it->second;
+
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    for (int cpu : placement.cpus) {
+        CPU_SET(cpu, &mask);
+    }
+    if (sched_setaffinity(0, sizeof(mask), &mask)) {
+        SWARN("Couldn't place thread '" << threadName << "' on CPUs " << composeCPUList(placement.cpus) << ": "
+              << strerror(errno));
+        return;
+    }
+
+    // Prefer memory from the thread's own node. Anything this thread allocates from here on, including its SQLite
+    // page cache, which is allocated when its handle is first used, comes from that node while it has memory free.
+    if (placement.node >= 0) {
+        const size_t bits = sizeof(unsigned long) * 8;
+        vector<unsigned long> nodes(placement.node / bits + 1, 0);
+        nodes[placement.node / bits] = 1ul << (placement.node % bits);
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, nodes.data(), nodes.size() * bits + 1)) {
+            SWARN("Couldn't prefer memory from NUMA node " << placement.node << " for thread '" << threadName
+                  << "': " << strerror(errno));
+        }
+    }
+
+    // Record where the thread actually ended up, which can be narrower than asked for if some CPUs are offline or
+    // outside our cgroup.
+    if (!sched_getaffinity(0, sizeof(mask), &mask)) {
+        set<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &mask)) {
+                cpus.insert(cpu);
+            }
+        }
+        string description = composeCPUList(cpus);
+        if (placement.node >= 0) {
+            description += " (node" + to_string(placement.node) + ")";
+        }
+        lock_guard<mutex> lock(_placementsMutex);
+        _placements[role] = description;
+    }
+}
+
+STable SThreadPlacement::getPlacements() {
+    lock_guard<mutex> lock(_placementsMutex);
+    return _placements;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <libstuff/libstuff.h>
+
+// SThreadPlacement pins threads to CPUs according to their role, so that on multi-socket machines, the threads that
+// share data (e.g., a worker and its SQLite page cache) stay on one NUMA node. A thread's role is its name, as passed
+// to `SInitialize`, without any trailing number, so "worker3" and "worker12" are both "worker".
+//
+// A policy is a list of `role:placement` entries separated by semicolons, where each placement is either a list of
+// CPUs in the same format as the kernel uses in /sys (e.g., "0-3,8"), or "node" followed by a NUMA node number (e.g.,
+// "node1"), meaning every CPU on that node. Threads pinned to a node also prefer to allocate memory from it, so their
+// buffers and page caches are local. Threads pinned to a list of CPUs allocate from whichever node they're running on,
+// which is the kernel's default. Roles without an entry are left alone.
+class SThreadPlacement {
+  public:
+    // Sets the policy. Invalid entries are logged and ignored. This must be called before any threads that should be
+    // placed are started.
+    static void configure(const string& policy);
+
+    // Places the calling thread, according to the role for `threadName`. Called by `SInitialize`.
+    static void apply(const string& threadName);
+
+    // Returns the CPUs that each role's threads were actually placed on, for roles that have been placed.
+    static STable getPlacements();
+
+    // Parses a CPU list like "0-3,8". Returns an empty set if it's malformed.
+    static set<int> parseCPUList(const string& list);
+
+    // Formats a set of CPUs as a CPU list.
+    static string composeCPUList(const set<int>& cpus);
+
+  private:
+    struct Placement {
+        set<int> cpus;
+
+        // -1 unless the placement was a NUMA node.
+        int node;
+    };
+
+    static map<string, Placement> _policy;
+    static STable _placements;
+    static mutex _placementsMutex;
+};
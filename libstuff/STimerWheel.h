@@ -0,0 +1,226 @@
+#pragma once
+#include <libstuff/libstuff.h>
+
+// STimerWheel holds items until a time (in microseconds, like STimeNow) when they come due. It's a hierarchical timing
+// wheel: time is divided into ticks of about a millisecond, and items are kept in buckets by tick, on one of several
+// levels of wheels, each of whose buckets covers 64 buckets of the level below. Inserting an item is O(1), and as time
+// advances, items move down a level each time their bucket comes round, until they're handed back from the bottom
+// level when they're due. Items due further out than the top wheel covers wait in an overflow list until they're in
+// range.
+//
+// Items within the current tick are compared with their exact due times, so an item is never handed back early or
+// more than one call to `advance` late. `nextDue` tells callers when to call `advance` again.
+//
+// This class isn't thread-safe.
+template<typename T>
+class STimerWheel {
+  public:
+    STimerWheel(uint64_t now = STimeNow()) : _current(now >> TICK_BITS), _size(0), _levelSizes{} {}
+
+    // Adds `item` to be handed back once `when` has passed. An item that's already due is handed back on the next call
+    // to `advance`.
+    void insert(uint64_t when, T&& item);
+
+    // Removes every item due at or before `now`, and calls `callback` with each one, in roughly the order they came
+    // due. `callback` must not insert into the wheel.
+    template<typename F>
+    void advance(uint64_t now, F&& callback);
+
+    // Returns a time at or before which the next item is due (exactly when, if it's within the next 64 ticks), or
+    // UINT64_MAX if the wheel is empty. Calling `advance` at that time makes progress towards handing it back.
+    uint64_t nextDue() const;
+
+    // Removes every item for which `predicate` returns true, without handing it back. This visits every item.
+    template<typename F>
+    void removeIf(F&& predicate);
+
+    void clear();
+
+    size_t size() const { return _size; }
+    bool empty() const { return !_size; }
+
+    // A tick is 1024us, and each of the four levels has 64 buckets, so the top level covers about 4.8 hours.
+    static constexpr int TICK_BITS = 10;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr uint64_t SLOTS = 1 << SLOT_BITS;
+    static constexpr int LEVELS = 4;
+
+  private:
+    struct Timer {
+        uint64_t when;
+        T item;
+    };
+
+    // Puts `timer` in the right bucket for the current tick.
+    void _place(Timer&& timer);
+
+    // Moves everything in the bucket of `level` that's come round at the current tick down to lower levels.
+    void _cascade(int level);
+
+    // The current tick. Everything in earlier ticks has been handed back.
+    uint64_t _current;
+    size_t _size;
+    size_t _levelSizes[LEVELS];
+    vector<Timer> _buckets[LEVELS][SLOTS];
+    vector<Timer> _overflow;
+};
+
+template<typename T>
+void STimerWheel<T>::_place(Timer&& timer) {
+    const uint64_t tick = max(timer.when >> TICK_BITS, _current);
+    const uint64_t delta = tick - _current;
+    for (int level = 0; level < LEVELS; level++) {
+        if (delta < (SLOTS << (SLOT_BITS * level))) {
+            _buckets[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(move(timer));
+            _levelSizes[level]++;
+            return;
+        }
+    }
+    _overflow.push_back(move(timer));
+}
+
+template<typename T>
+void STimerWheel<T>::insert(uint64_t when, T&& item) {
+    _place({when, move(item)});
+    _size++;
+}
+
+template<typename T>
+void STimerWheel<T>::_cascade(int level) {
+    // Swap the bucket out first, as its timers may be placed back into the same level.
+    vector<Timer> bucket;
+    bucket.swap(_buckets[level][(_current >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+    _levelSizes[level] -= bucket.size();
+    for (Timer& timer : bucket) {
+        _place(move(timer));
+    }
+}
+
+template<typename T>
+template<typename F>
+void STimerWheel<T>::advance(uint64_t now, F&& callback) {
+    const uint64_t target = now >> TICK_BITS;
+    while (_current < target) {
+        // The current tick has passed, so everything left in its bucket is due.
+        vector<Timer>& bucket = _buckets[0][_current & (SLOTS - 1)];
+        for (Timer& timer : bucket) {
+            callback(timer.item);
+        }
+        _size -= bucket.size();
+        _levelSizes[0] -= bucket.size();
+        bucket.clear();
+
+        // Skip over ticks where nothing can happen: if the bottom level is empty, nothing can come due until a bucket
+        // comes round on the lowest level that has anything in it. The overflow comes back into range when the top
+        // level comes round.
+        uint64_t next = _current + 1;
+        if (!_levelSizes[0]) {
+            int level = 1;
+            while (level < LEVELS && !_levelSizes[level]) {
+                level++;
+            }
+            const int shift = SLOT_BITS * min(level, LEVELS - 1);
+            next = level == LEVELS && _overflow.empty() ? target : ((_current >> shift) + 1) << shift;
+        }
+        _current = min(next, target);
+
+        // Bring down anything whose higher level bucket has just come round, highest first, so it can keep falling.
+        const uint64_t topMask = (1ull << (SLOT_BITS * (LEVELS - 1))) - 1;
+        if (!(_current & topMask) && !_overflow.empty()) {
+            vector<Timer> overflow;
+            overflow.swap(_overflow);
+            for (Timer& timer : overflow) {
+                _place(move(timer));
+            }
+        }
+        for (int level = LEVELS - 1; level > 0; level--) {
+            if (!(_current & ((1ull << (SLOT_BITS * level)) - 1))) {
+                _cascade(level);
+            }
+        }
+    }
+
+    // Within the current tick, only hand back what's actually due.
+    vector<Timer>& bucket = _buckets[0][_current & (SLOTS - 1)];
+    auto due = partition(bucket.begin(), bucket.end(), [now](const Timer& timer) { return timer.when > now; });
+    for (auto it = due; it != bucket.end(); it++) {
+        callback(it->item);
+    }
+    const size_t handed = distance(due, bucket.end());
+    _size -= handed;
+    _levelSizes[0] -= handed;
+    bucket.erase(due, bucket.end());
+}
+
+template<typename T>
+uint64_t STimerWheel<T>::nextDue() const {
+    if (!_size) {
+        return UINT64_MAX;
+    }
+
+    // The bottom level holds exact times for the next 64 ticks.
+    uint64_t next = UINT64_MAX;
+    if (_levelSizes[0]) {
+        for (uint64_t i = 0; i < SLOTS && next == UINT64_MAX; i++) {
+            for (const Timer& timer : _buckets[0][(_current + i) & (SLOTS - 1)]) {
+                next = min(next, timer.when);
+            }
+        }
+    }
+
+    // Higher levels only know that their items are due no earlier than the start of their bucket, which is when the
+    // bucket is cascaded. A higher level can hold items due sooner than a lower one, as items only move down when
+    // their bucket comes round, so we check them all.
+    for (int level = 1; level < LEVELS; level++) {
+        if (!_levelSizes[level]) {
+            continue;
+        }
+        const uint64_t position = _current >> (SLOT_BITS * level);
+        for (uint64_t i = 1; i <= SLOTS; i++) {
+            if (!_buckets[level][(position + i) & (SLOTS - 1)].empty()) {
+                next = min(next, ((position + i) << (SLOT_BITS * level)) << TICK_BITS);
+                break;
+            }
+        }
+    }
+
+    // The overflow is brought into range when the top level next comes round.
+    if (!_overflow.empty()) {
+        const int topShift = SLOT_BITS * (LEVELS - 1);
+        next = min(next, (((_current >> topShift) + 1) << topShift) << TICK_BITS);
+    }
+    return next;
+}
+
+template<typename T>
+template<typename F>
+void STimerWheel<T>::removeIf(F&& predicate) {
+    auto sweep = [&predicate](vector<Timer>& bucket) {
+        auto removed = remove_if(bucket.begin(), bucket.end(), [&predicate](Timer& timer) {
+            return predicate(timer.item);
+        });
+        size_t count = distance(removed, bucket.end());
+        bucket.erase(removed, bucket.end());
+        return count;
+    };
+    for (int level = 0; level < LEVELS; level++) {
+        for (auto& bucket : _buckets[level]) {
+            size_t count = sweep(bucket);
+            _levelSizes[level] -= count;
+            _size -= count;
+        }
+    }
+    _size -= sweep(_overflow);
+}
+
+template<typename T>
+void STimerWheel<T>::clear() {
+    for (int level = 0; level < LEVELS; level++) {
+        for (auto& bucket : _buckets[level]) {
+            bucket.clear();
+        }
+        _levelSizes[level] = 0;
+    }
+    _overflow.clear();
+    _size = 0;
+}
@@ -105,6 +105,9 @@ void SInitialize(string threadName, const char* processName) {
     SLogSetThreadName(threadName);
     SLogSetThreadPrefix("xxxxxx ");
     SInitializeSignals();
+
+    // Pin the thread before it allocates anything, so its memory comes from the node it runs on.
+    SThreadPlacement::apply(threadName);
 }
 
 // Thread-local log prefix
@@ -750,172 +753,228 @@ void _SParseHTTP_GetUpToEnd(const char* start, const char* end, string& out) {
 
 // --------------------------------------------------------------------------
 int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& nameValueMap, string& content) {
+    SHTTPParser parser;
+    return parser.parse(buffer, length, methodLine, nameValueMap, content);
+}
+
+// --------------------------------------------------------------------------
+SHTTPParser::SHTTPParser() {
+    reset();
+}
+
+// --------------------------------------------------------------------------
+void SHTTPParser::reset() {
+    _methodLine.clear();
+    _nameValueMap.clear();
+    _content.clear();
+    _name.clear();
+    _lineOffset = 0;
+    _scanOffset = 0;
+    _contentOffset = 0;
+    _messageLength = 0;
+    _isChunked = false;
+    _lastChunkFound = false;
+    _chunkLength = 0;
+}
+
+// --------------------------------------------------------------------------
+int SHTTPParser::_finish(size_t messageLength, string& methodLine, STable& nameValueMap, string& content) {
+    methodLine = move(_methodLine);
+    nameValueMap = move(_nameValueMap);
+    content = move(_content);
+    reset();
+    return (int)messageLength;
+}
+
+// --------------------------------------------------------------------------
+void SHTTPParser::_parseHeaderLine(const char* lineStart, const char* lineEnd) {
+    // Does it start with whitespace?  If so, just append to the last value
+    if (isspace(*lineStart)) {
+        // Starts with whitespace -- if we have a name, add it to the end of the last
+        // value.  Otherwise, add it to the end of the method.
+        if (!_name.empty())
+            SAppend(_nameValueMap[_name], lineStart, (int)(lineEnd - lineStart));
+        else
+            SAppend(_methodLine, lineStart, (int)(lineEnd - lineStart));
+    } else {
+        // Parse name/value pair.  Name is everything up to the ':'
+        const char* nameEnd = _SParseHTTP_GetUpToNext(lineStart, lineEnd, ':', _name);
+        if (!_name.empty()) {
+            // The value is everything up to the end of the line,
+            // triming leading and trailing whitespace.
+            const char* valueStart = nameEnd + 1;
+            const char* valueEnd = lineEnd;
+            while (*valueStart == ' ')
+                ++valueStart;
+            while (*(valueEnd - 1) == ' ')
+                --valueEnd;
+            int valueLength = (int)(valueEnd - valueStart);
+            string value;
+            if (valueLength > 0) {
+                // Copy the value
+                value.resize(valueLength);
+                memcpy(&value[0], valueStart, valueLength);
+            }
+
+            // Store the result.  If there's something already
+            // there just override, with the exception of
+            // Set-Cookie: generate a crappy list with 0xFF
+            // separation.  (See SComposeHTTP for explanation.)
+            STable::iterator it = _nameValueMap.find(_name);
+            if (it == _nameValueMap.end() || !SIEquals(_name, "Set-Cookie"))
+                _nameValueMap[_name] = SUnescape(value); // strip any slash-escaping
+            else
+                _nameValueMap[_name] = it->second + S_COOKIE_SEPARATOR + value;
+        }
+    }
+}
+
+// --------------------------------------------------------------------------
+int SHTTPParser::parse(const char* buffer, size_t length, string& methodLine, STable& nameValueMap, string& content) {
     // Clear the output
     methodLine.clear();
     nameValueMap.clear();
     content.clear();
 
-    // Keep parsing until we run out of input or encounter a blank line
-    const char* lineStart = buffer;
+    // If the buffer has shrunk, it's not the one we were parsing, so start over.
+    if (length < max(_lineOffset, _scanOffset)) {
+        reset();
+    }
+
+    // If we've already parsed the headers, all we need is for the rest of the content to arrive.
     const char* inputEnd = buffer + length;
-    string name;
-    bool isChunked = false;
-    bool lastChunkFound = false;
-    while (lineStart < inputEnd) {
-        // Find the end of the line
-        const char* lineEnd = lineStart;
-        while ((lineEnd < inputEnd) && (*lineEnd != '\r') && (*lineEnd != '\n'))
-            ++lineEnd;
-        if (lineEnd >= inputEnd) {
-            // Couldn't find end of line; couldn't complete parsing.
-            methodLine.clear();
-            nameValueMap.clear();
-            content.clear();
+    if (_messageLength) {
+        if (length < _messageLength) {
             return 0;
         }
+        _content.assign(buffer + _contentOffset, _messageLength - _contentOffset);
+        return _finish(_messageLength, methodLine, nameValueMap, content);
+    }
 
-        // Found the end of the line; is the line blank?
-        if (lineEnd == lineStart) {
-            // Blank line -- if we have at least the method, then we're done.  Otherwise, ignore.
-
-            // We want to look this up without inserting it.
-            auto it = nameValueMap.find("Transfer-Encoding");
-            if (!methodLine.empty()) {
-                // If we are done processing a chunked body.
-                if (isChunked) {
-                    // Figure out the end of the message by consuming up to 2 EOL characters,
-                    // then return the total length.
-                    SASSERTWARN(lastChunkFound);
-                    const char* parseEnd = lineEnd;
-                    int numEOLs = 2;
-                    while (parseEnd < inputEnd && (*parseEnd == '\r' || *parseEnd == '\n') && numEOLs--)
-                        ++parseEnd;
-                    return (int)(parseEnd - buffer);
-                }
+    // Keep parsing until we run out of input or encounter a blank line. Whenever we run out of input partway through
+    // something, we return leaving our offsets pointing at it, so the next call can continue from there.
+    const char* lineStart = buffer + _lineOffset;
+    while (lineStart < inputEnd) {
+        // Are we waiting on the data for a chunk?
+        const char* lineEnd;
+        if (_chunkLength) {
+            // We need the whole chunk plus at least two bytes after it to know how its line ending is terminated.
+            const char* chunkEnd = lineStart + _chunkLength;
+            if (chunkEnd + 1 >= inputEnd) {
+                return 0;
+            }
+
+            // Get the chunk and advance the pointers.
+            SAppend(_content, lineStart, (int)_chunkLength);
+            _chunkLength = 0;
+            lineEnd = chunkEnd;
+        } else {
+            // Find the end of the line, starting from wherever we stopped looking last time.
+            lineEnd = max(lineStart, buffer + _scanOffset);
+            while ((lineEnd < inputEnd) && (*lineEnd != '\r') && (*lineEnd != '\n'))
+                ++lineEnd;
+            if (lineEnd >= inputEnd) {
+                // Couldn't find end of line; couldn't complete parsing.
+                _scanOffset = lineEnd - buffer;
+                return 0;
+            }
 
-                // If not processing a chunked body, then finish up.
-                else if (it == nameValueMap.end() || !SIEquals(it->second, "chunked")) {
-                    // We have a method -- we're done.  Figure out the end of the message
-                    // by consuming up to 2 EOL characters, then return the total length.
+            // Found the end of the line; is the line blank?
+            if (lineEnd == lineStart) {
+                // Blank line -- if we have at least the method, then we're done.  Otherwise, ignore.
+                if (!_methodLine.empty()) {
+                    // Figure out the end of the message by consuming up to 2 EOL characters.
                     const char* parseEnd = lineEnd;
                     int numEOLs = 2;
                     while (parseEnd < inputEnd && (*parseEnd == '\r' || *parseEnd == '\n') && numEOLs--)
                         ++parseEnd;
-                    int headerLength = (int)(parseEnd - buffer);
-
-                    // If there is no content-length, just return the length of the headers
-                    int contentLength = (SContains(nameValueMap, "Content-Length")
-                                             ? atoi(nameValueMap["Content-Length"].c_str())
-                                             : 0);
-                    if (!contentLength)
-                        return headerLength;
-
-                    // There is a content length -- if we don't have enough, then cancel the parse.
-                    if ((int)(length - headerLength) < contentLength) {
-                        // Insufficient content
-                        methodLine.clear();
-                        nameValueMap.clear();
-                        content.clear();
-                        return 0;
-                    }
-
-                    // We have enough data -- copy it and return the full length
-                    content.resize(contentLength);
-                    memcpy(&content[0], parseEnd, contentLength);
-                    return (headerLength + contentLength);
-                }
 
-                // Otherwise, we start on a chunked body.
-                else
-                    isChunked = true;
-            }
-        } else {
-            // Not blank.  Is this the method line?
-            bool isHeaderOrFooter = true;
-            if (methodLine.empty()) {
-                // Everything in the line is the method
-                _SParseHTTP_GetUpToEnd(lineStart, lineEnd, methodLine);
-                isHeaderOrFooter = false;
-            }
+                    // If we are done processing a chunked body, return the total length.
+                    auto it = _nameValueMap.find("Transfer-Encoding");
+                    if (_isChunked) {
+                        SASSERTWARN(_lastChunkFound);
+                        return _finish(parseEnd - buffer, methodLine, nameValueMap, content);
+                    }
 
-            // Is it a new chunk?
-            else if (isChunked) {
-                // Get the chunk length and ignore the optional stuff after the optional semicolon.
-                string chunkHeader;
-                _SParseHTTP_GetUpToEnd(lineStart, lineEnd, chunkHeader);
-                const string& hexChunkLength = SContains(chunkHeader, ";") ? SBefore(chunkHeader, ";") : chunkHeader;
+                    // If not processing a chunked body, then finish up.
+                    else if (it == _nameValueMap.end() || !SIEquals(it->second, "chunked")) {
+                        // If there is no content-length, just return the length of the headers
+                        size_t headerLength = parseEnd - buffer;
+                        auto contentLengthIt = _nameValueMap.find("Content-Length");
+                        int contentLength =
+                            contentLengthIt != _nameValueMap.end() ? atoi(contentLengthIt->second.c_str()) : 0;
+                        if (contentLength <= 0)
+                            return _finish(headerLength, methodLine, nameValueMap, content);
+
+                        // If the input ends partway through the line ending, wait until we can see all of it, as it
+                        // changes where the content starts.
+                        if (parseEnd == inputEnd && numEOLs > 0) {
+                            _scanOffset = lineEnd - buffer;
+                            return 0;
+                        }
 
-                // If valid hex number, then we have a chunk.
-                if (SREMatch("^[a-fA-F0-9]{1,8}$", hexChunkLength)) {
-                    // Get the chunk length.
-                    isHeaderOrFooter = false;
-                    int chunkLength = (int)SFromHex(hexChunkLength);
-                    if (chunkLength) {
-                        // Verify that we can get the entire chunk.
-                        const char* chunkStart = lineEnd + 2; // skipping the \r\n.
-                        const char* chunkEnd = chunkStart + chunkLength;
-                        if (chunkEnd >= inputEnd) {
-                            // Insufficient content
-                            methodLine.clear();
-                            nameValueMap.clear();
-                            content.clear();
+                        // Remember where the message ends, and return it if we already have all of it.
+                        _contentOffset = headerLength;
+                        _messageLength = headerLength + contentLength;
+                        if (length < _messageLength) {
                             return 0;
                         }
+                        _content.assign(parseEnd, contentLength);
+                        return _finish(_messageLength, methodLine, nameValueMap, content);
+                    }
 
-                        // Get the chunk and advance the pointers.
-                        size_t contentLength = content.length();
-                        content.resize(contentLength + chunkLength);
-                        memcpy(&content[contentLength], chunkStart, chunkLength);
-                        lineEnd = chunkEnd;
+                    // Otherwise, we start on a chunked body, once we can see the whole line ending.
+                    else if (lineEnd + 1 >= inputEnd) {
+                        _scanOffset = lineEnd - buffer;
+                        return 0;
                     } else
-                        lastChunkFound = true;
+                        _isChunked = true;
+                }
+            } else {
+                // Not blank.  We can't tell how the line ending is terminated until we can see past its first byte.
+                if (lineEnd + 1 >= inputEnd) {
+                    _scanOffset = lineEnd - buffer;
+                    return 0;
                 }
 
-                // Else it is a footer which should be treated just like a header.  Set it again for clarity.
-                else
-                    isHeaderOrFooter = true;
-            }
+                // Is this the method line?
+                bool isHeaderOrFooter = true;
+                if (_methodLine.empty()) {
+                    // Everything in the line is the method
+                    _SParseHTTP_GetUpToEnd(lineStart, lineEnd, _methodLine);
+                    isHeaderOrFooter = false;
+                }
 
-            // More headers.
-            if (isHeaderOrFooter) {
-                // Does it start with whitespace?  If so, just append to the last value
-                if (isspace(*lineStart)) {
-                    // Starts with whitespace -- if we have a name, add it to the end of the last
-                    // value.  Otherwise, add it to the end of the method.
-                    if (!name.empty())
-                        SAppend(nameValueMap[name], lineStart, (int)(lineEnd - lineStart));
+                // Is it a new chunk?
+                else if (_isChunked) {
+                    // Get the chunk length and ignore the optional stuff after the optional semicolon.
+                    string chunkHeader;
+                    _SParseHTTP_GetUpToEnd(lineStart, lineEnd, chunkHeader);
+                    const string& hexChunkLength = SContains(chunkHeader, ";") ? SBefore(chunkHeader, ";") : chunkHeader;
+
+                    // If valid hex number, then we have a chunk.
+                    if (SREMatch("^[a-fA-F0-9]{1,8}$", hexChunkLength)) {
+                        // Get the chunk length.
+                        isHeaderOrFooter = false;
+                        size_t chunkLength = SFromHex(hexChunkLength);
+                        if (chunkLength) {
+                            // Skip the \r\n and wait for the chunk data, starting on the next pass through the loop.
+                            _chunkLength = chunkLength;
+                            lineStart = lineEnd + 2;
+                            _lineOffset = lineStart - buffer;
+                            continue;
+                        } else
+                            _lastChunkFound = true;
+                    }
+
+                    // Else it is a footer which should be treated just like a header.  Set it again for clarity.
                     else
-                        SAppend(methodLine, lineStart, (int)(lineEnd - lineStart));
-                } else {
-                    // Parse name/value pair.  Name is everything up to the ':'
-                    const char* nameEnd = _SParseHTTP_GetUpToNext(lineStart, lineEnd, ':', name);
-                    if (!name.empty()) {
-                        // The value is everything up to the end of the line,
-                        // triming leading and trailing whitespace.
-                        const char* valueStart = nameEnd + 1;
-                        const char* valueEnd = lineEnd;
-                        while (*valueStart == ' ')
-                            ++valueStart;
-                        while (*(valueEnd - 1) == ' ')
-                            --valueEnd;
-                        int valueLength = (int)(valueEnd - valueStart);
-                        string value;
-                        if (valueLength > 0) {
-                            // Copy the value
-                            value.resize(valueLength);
-                            memcpy(&value[0], valueStart, valueLength);
-                        }
+                        isHeaderOrFooter = true;
+                }
 
-                        // Store the result.  If there's something already
-                        // there just override, with the exception of
-                        // Set-Cookie: generate a crappy list with 0xFF
-                        // separation.  (See SComposeHTTP for explanation.)
-                        STable::iterator it = nameValueMap.find(name);
-                        if (it == nameValueMap.end() || !SIEquals(name, "Set-Cookie"))
-                            nameValueMap[name] = SUnescape(value); // strip any slash-escaping
-                        else
-                            nameValueMap[name] = it->second + S_COOKIE_SEPARATOR + value;
-                    }
+                // More headers.
+                if (isHeaderOrFooter) {
+                    _parseHeaderLine(lineStart, lineEnd);
                 }
             }
         }
@@ -932,12 +991,11 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
             ++lineStart;
         else
             SWARN("How did we get here?");
+        _lineOffset = lineStart - buffer;
+        _scanOffset = _lineOffset;
     }
 
     // Reached the end of the input and haven't finished parsing the header
-    methodLine.clear();
-    nameValueMap.clear();
-    content.clear();
     return 0;
 }
 
@@ -1107,7 +1165,10 @@ bool SParseURIPath(const char* buffer, int length, string& path, STable& nameVal
 }
 
 // --------------------------------------------------------------------------
-void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
+// Composes the method line and headers of an HTTP-like message for the given content. If the headers ask for gzip
+// encoding and the content compresses, the compressed content is returned in `gzipContent`, otherwise it's left empty.
+static void _SComposeHTTPHeaders(string& buffer, const string& methodLine, const STable& nameValueMap,
+                                 const string& content, string& gzipContent) {
     bool tryGzip = false;
 
     // Just walk across and compose a valid HTTP-like message
@@ -1133,20 +1194,34 @@ void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameVa
         }
     }
 
-    const string gzipContent = tryGzip ? SGZip(content) : "";
+    gzipContent = tryGzip ? SGZip(content) : "";
     const bool gzipSuccess = !gzipContent.empty();
-    const string& finalContent = gzipSuccess ? gzipContent : content;
+    const size_t contentLength = gzipSuccess ? gzipContent.size() : content.size();
 
     if (gzipSuccess) {
         buffer += "Content-Encoding: gzip\r\n";
     }
 
     // Always add a Content-Length, even if no content, so there is no ambiguity
-    buffer += "Content-Length: " + SToStr(finalContent.size()) + "\r\n";
+    buffer += "Content-Length: " + SToStr(contentLength) + "\r\n";
 
-    // Finish the message and add the content, if any
+    // Finish the headers.
     buffer += "\r\n";
-    buffer += finalContent;
+}
+
+void SComposeHTTP(string& buffer, const string& methodLine, const STable& nameValueMap, const string& content) {
+    // Compose the headers, and add the content, if any
+    string gzipContent;
+    _SComposeHTTPHeaders(buffer, methodLine, nameValueMap, content, gzipContent);
+    buffer += gzipContent.empty() ? content : gzipContent;
+}
+
+void SComposeHTTPHeaders(string& buffer, const string& methodLine, const STable& nameValueMap, string& content) {
+    string gzipContent;
+    _SComposeHTTPHeaders(buffer, methodLine, nameValueMap, content, gzipContent);
+    if (!gzipContent.empty()) {
+        content = move(gzipContent);
+    }
 }
 
 // --------------------------------------------------------------------------
@@ -1683,39 +1758,10 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
             STHROW("invalid host: " + host);
         }
 
-        // Is the domain just a raw IP?
-        unsigned int ip = inet_addr(domain.c_str());
-        if (!ip || ip == INADDR_NONE) {
-            // Nope -- resolve the domain
-            uint64_t start = STimeNow();
-
-            // Allocate and initialize addrinfo structures.
-            struct addrinfo hints;
-            memset(&hints, 0, sizeof hints);
-            struct addrinfo* resolved = nullptr;
-
-            // Set up the hints.
-            hints.ai_family = AF_INET; // IPv4
-            hints.ai_socktype = SOCK_STREAM;
-
-            // Do the initialization.
-            int result = getaddrinfo(domain.c_str(), to_string(port).c_str(), &hints, &resolved);
-            SINFO("DNS lookup took " << (STimeNow() - start) / 1000 << "ms for '" << domain << "'.");
-
-            // There was a problem.
-            if (result || !resolved) {
-                freeaddrinfo(resolved);
-                STHROW("can't resolve host error no#" + result);
-            }
-            // Grab the resolved address.
-            sockaddr_in* addr = (sockaddr_in*)resolved->ai_addr;
-            ip = addr->sin_addr.s_addr;
-            char plainTextIP[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &addr->sin_addr, plainTextIP, INET_ADDRSTRLEN);
-            SINFO("Resolved " << domain << " to ip: " << plainTextIP << ".");
-
-            // Done resolving.
-            freeaddrinfo(resolved);
+        // Resolve the domain, if it's not just a raw IP. This goes through the resolver's cache, but waits for it.
+        in_addr_t ip = SDNSResolver::resolveNow(domain);
+        if (ip == INADDR_NONE) {
+            STHROW("can't resolve host");
         }
 
         // Open a socket
@@ -1754,26 +1800,8 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
             // Start listening, if TCP
             if (isTCP && listen(s, SOMAXCONN))
                 STHROW("couldn't listen");
-        } else {
-            // If TCP, connect
-            sockaddr_in addr;
-            memset(&addr, 0, sizeof(addr));
-            addr.sin_family = AF_INET;
-            addr.sin_port = htons(port);
-            addr.sin_addr.s_addr = ip;
-            if (connect(s, (sockaddr*)&addr, sizeof(addr)) == -1)
-                switch (S_errno) {
-                case S_EWOULDBLOCK:
-                case S_EALREADY:
-                case S_EINPROGRESS:
-                case S_EINTR:
-                case S_EISCONN:
-                    // Not fatal, ignore
-                    break;
-
-                default:
-                    STHROW("couldn't connect");
-                }
+        } else if (!S_connect(s, ip, port)) {
+            STHROW("couldn't connect");
         }
 
         // Success, ready to go.
@@ -1788,6 +1816,30 @@ int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking) {
     }
 }
 
+// --------------------------------------------------------------------------
+bool S_connect(int s, in_addr_t ip, uint16_t port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = ip;
+    if (connect(s, (sockaddr*)&addr, sizeof(addr)) == -1) {
+        switch (S_errno) {
+        case S_EWOULDBLOCK:
+        case S_EALREADY:
+        case S_EINPROGRESS:
+        case S_EINTR:
+        case S_EISCONN:
+            // Not fatal, ignore
+            break;
+
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
 // --------------------------------------------------------------------------
 ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fromAddr) {
     SASSERT(s);
@@ -1848,18 +1900,11 @@ int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking) {
     // Try to receive into the buffer
     socklen_t fromAddrLen = sizeof(fromAddr);
     memset(&fromAddr, 0, sizeof(fromAddr));
-    int s = (int)accept(port, (sockaddr*)&fromAddr, &fromAddrLen);
+    // Enable non-blocking, if requested, as part of the accept rather than with two more system calls afterward.
+    int s = (int)accept4(port, (sockaddr*)&fromAddr, &fromAddrLen, isBlocking ? 0 : SOCK_NONBLOCK);
 
     // Process the result
     if (s != -1) {
-        // Enable non-blocking, if requested.
-        if (!isBlocking) {
-            // Set non-blocking
-            int flags = fcntl(s, F_GETFL);
-            if ((flags < 0) || fcntl(s, F_SETFL, flags | O_NONBLOCK))
-                STHROW("couldn't set non-blocking");
-        }
-
         // Accepted a valid socket; return
         return s;
     } else {
@@ -1951,7 +1996,15 @@ bool S_recvappend(int s, SFastBuffer& recvBuffer) {
         SINFO("[performance] " << bytesInBuffer << " bytes in the socket buffer before receiving.");
     }
 
-    // Keep trying to receive as long as we can
+    // If we're still full from last time, nothing could be parsed out of a whole buffer, so the message we're waiting
+    // for is too big to ever arrive.
+    if (recvBuffer.size() >= SFastBuffer::MAX_RECV_SIZE) {
+        SWARN("Receive buffer holds " << recvBuffer.size() << " bytes without a complete message, closing.");
+        return false;
+    }
+
+    // Keep trying to receive as long as we can, or until the buffer's full, in which case we leave the rest in the
+    // socket until what we have is consumed.
     char buffer[4096];
     int totalRecv = 0;
     ssize_t numRecv = 0;
@@ -1963,7 +2016,7 @@ bool S_recvappend(int s, SFastBuffer& recvBuffer) {
         totalRecv += numRecv;
 
         // If this is a blocking socket, don't try again, once is enough
-        if (blocking) {
+        if (blocking || recvBuffer.size() >= SFastBuffer::MAX_RECV_SIZE) {
             return true; // We're still alive
         }
     }
@@ -1986,8 +2039,12 @@ bool S_sendconsume(int s, SFastBuffer& sendBuffer) {
         return true; // Assume no error, still alive
     }
 
+    // We send the buffer a chunk at a time, rather than joining it into one string first.
+    vector<iovec> iov;
+    sendBuffer.gather(iov);
+
     // 17 is size of "ESCALATE_RESPONSE".
-    if (SStartsWith(sendBuffer.c_str(), sendBuffer.size(), "ESCALATE_RESPONSE", 17)) {
+    if (SStartsWith((const char*)iov.front().iov_base, iov.front().iov_len, "ESCALATE_RESPONSE", 17)) {
         SData tempData;
         tempData.deserialize(sendBuffer);
         string id = tempData["id"];
@@ -1997,8 +2054,11 @@ bool S_sendconsume(int s, SFastBuffer& sendBuffer) {
     // Timer for tracking how long the call to send is taking to debug slow ESCALATE_RESPONSEs
     chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
-    // Send as much as we can
-    ssize_t numSent = send(s, sendBuffer.c_str(), sendBuffer.size(), MSG_NOSIGNAL);
+    // Send as much as we can. We use sendmsg rather than writev for MSG_NOSIGNAL.
+    msghdr message = {};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = iov.size();
+    ssize_t numSent = sendmsg(s, &message, MSG_NOSIGNAL);
     string errorMessage;
     if (numSent == -1) {
         errorMessage = " Error: "s + strerror(errno);
@@ -2026,6 +2086,70 @@ bool S_sendconsume(int s, SFastBuffer& sendBuffer) {
     return SCheckNetworkErrorType("send", SGetPeerName(s), S_errno);
 }
 
+void S_sendvector(const SFastBuffer& sendBuffer, const list<string>& chunks, size_t chunkOffset, vector<iovec>& iov) {
+    // Gather the buffer and as many chunks as we can into a single call, starting `chunkOffset` bytes into the first
+    // chunk (which is how much of it was already sent).
+    iov.clear();
+    sendBuffer.gather(iov);
+    size_t offset = chunkOffset;
+    for (const string& chunk : chunks) {
+        if (iov.size() == IOV_MAX) {
+            break;
+        }
+        if (chunk.size() > offset) {
+            iov.push_back({(void*)(chunk.data() + offset), chunk.size() - offset});
+        }
+        offset = 0;
+    }
+}
+
+void S_sendadvance(SFastBuffer& sendBuffer, list<string>& chunks, size_t& chunkOffset, size_t numSent) {
+    // Consume what was sent, first from the buffer, then whole chunks, then part of the next chunk.
+    size_t remaining = numSent;
+    size_t fromBuffer = min(remaining, sendBuffer.size());
+    sendBuffer.consumeFront(fromBuffer);
+    remaining -= fromBuffer;
+    while (remaining && !chunks.empty()) {
+        size_t available = chunks.front().size() - chunkOffset;
+        if (remaining < available) {
+            chunkOffset += remaining;
+            break;
+        }
+        remaining -= available;
+        chunks.pop_front();
+        chunkOffset = 0;
+    }
+
+    // Drop any empty chunks left at the front.
+    while (!chunks.empty() && chunkOffset >= chunks.front().size()) {
+        chunks.pop_front();
+        chunkOffset = 0;
+    }
+}
+
+bool S_sendconsume(int s, SFastBuffer& sendBuffer, list<string>& chunks, size_t& chunkOffset) {
+    vector<iovec> iov;
+    S_sendvector(sendBuffer, chunks, chunkOffset, iov);
+    if (iov.empty()) {
+        chunks.clear();
+        chunkOffset = 0;
+        return true;
+    }
+
+    // We use sendmsg rather than writev for MSG_NOSIGNAL.
+    msghdr message = {};
+    message.msg_iov = iov.data();
+    message.msg_iovlen = iov.size();
+    ssize_t numSent = sendmsg(s, &message, MSG_NOSIGNAL);
+    if (numSent >= 0) {
+        S_sendadvance(sendBuffer, chunks, chunkOffset, numSent);
+        return true;
+    }
+
+    // Error, what kind?
+    return SCheckNetworkErrorType("sendmsg", SGetPeerName(s), S_errno);
+}
+
 void SFDset(fd_map& fdm, int socket, short evts) {
     fd_map::iterator existing = fdm.find(socket);
     if (existing != fdm.end()) {
@@ -2054,6 +2178,9 @@ int S_poll(fd_map& fdm, uint64_t timeout) {
     // ever want to allow multiple threads to manipulate a shared fd_map directly, then we need locking in the related
     // functions.
 
+    // Managers with many sockets keep them registered in their own SEpoll, and only put its descriptor in the fd_map
+    // (see SEpoll.h), so this is usually only a handful of descriptors.
+
     // Build a vector we can use to pass data to poll().
     vector<pollfd> pollvec;
     for (pair<int, pollfd> pfd : fdm) {
@@ -7,14 +7,17 @@
 #include <execinfo.h> // for backtrace
 #include <fcntl.h>
 #include <libgen.h>   // for basename()
+#include <limits.h>   // for IOV_MAX
 #include <netinet/in.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdio.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h> // for gettimeofday()
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <syslog.h>
 #include <stdlib.h>
@@ -27,6 +30,7 @@
 #include <cctype>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <iomanip>
 #include <iostream>
 #include <list>
@@ -508,6 +512,53 @@ int SParseHTTP(const char* buffer, size_t length, string& methodLine, STable& na
 inline int SParseHTTP(const string& buffer, string& methodLine, STable& nameValueMap, string& content) {
     return SParseHTTP(buffer.c_str(), (int)buffer.size(), methodLine, nameValueMap, content);
 }
+
+// Resumable version of SParseHTTP for a buffer that's filled a bit at a time, like a socket's `recvBuffer`. Each call
+// to `parse` picks up where the previous one stopped rather than starting again from the beginning of the buffer, so
+// every byte of a message is only looked at once no matter how many reads it arrives in. This requires that between
+// calls, the buffer is only appended to. Once a complete message is returned, the parser resets for the next one, so
+// the caller should consume exactly the returned number of bytes from the front of the buffer. If the buffer is
+// changed any other way, call `reset`.
+class SHTTPParser {
+  public:
+    SHTTPParser();
+
+    // Same arguments and return value as SParseHTTP.
+    int parse(const char* buffer, size_t length, string& methodLine, STable& nameValueMap, string& content);
+
+    // Discards any partially parsed message.
+    void reset();
+
+  private:
+    // Moves the completed message into the output parameters, resets, and returns `messageLength`.
+    int _finish(size_t messageLength, string& methodLine, STable& nameValueMap, string& content);
+
+    // Parses a single complete header (or chunked-body footer) line.
+    void _parseHeaderLine(const char* lineStart, const char* lineEnd);
+
+    // The message parsed so far.
+    string _methodLine;
+    STable _nameValueMap;
+    string _content;
+
+    // The name of the last header parsed, for continuation lines.
+    string _name;
+
+    // Offset of the first line we haven't parsed yet, and how far into that line we've looked for its end.
+    size_t _lineOffset;
+    size_t _scanOffset;
+
+    // Once we've parsed the headers of a message with a `Content-Length`, the offset its content starts at, and the
+    // length of the entire message. Until then, both are 0.
+    size_t _contentOffset;
+    size_t _messageLength;
+
+    // State for chunked messages. If we've read a chunk header but not all of its data, `_chunkLength` is set, and
+    // `_lineOffset` is the start of that chunk's data.
+    bool _isChunked;
+    bool _lastChunkFound;
+    size_t _chunkLength;
+};
 bool SParseRequestMethodLine(const string& methodLine, string& method, string& uri);
 bool SParseResponseMethodLine(const string& methodLine, string& protocol, int& code, string& reason);
 bool SParseURI(const char* buffer, int length, string& host, string& path);
@@ -524,6 +575,11 @@ inline string SComposeHTTP(const string& methodLine, const STable& nameValueMap,
     SComposeHTTP(buffer, methodLine, nameValueMap, content);
     return buffer;
 }
+
+// Composes only the method line and headers of an HTTP-like message for `content`, so that the content can be sent
+// separately without being copied. If the headers request gzip encoding, `content` is replaced with its compressed
+// form.
+void SComposeHTTPHeaders(string& buffer, const string& methodLine, const STable& nameValueMap, string& content);
 string SComposePOST(const STable& nameValueMap);
 inline string SComposeHost(const string& host, int port) { return (host + ":" + SToStr(port)); }
 bool SParseHost(const string& host, string& domain, uint16_t& port);
@@ -626,6 +682,10 @@ bool SFDAnySet(fd_map& fdm, int socket, short evts);
 
 // Socket helpers
 int S_socket(const string& host, bool isTCP, bool isPort, bool isBlocking);
+
+// Starts connecting `s` to `ip` (in network byte order) and `port`. Returns false if the connect failed outright; a
+// non-blocking connect that's still in progress counts as success.
+bool S_connect(int s, in_addr_t ip, uint16_t port);
 int S_accept(int port, sockaddr_in& fromAddr, bool isBlocking);
 ssize_t S_recvfrom(int s, char* recvBuffer, int recvBufferSize, sockaddr_in& fromAddr);
 bool S_recvappend(int s, SFastBuffer& recvBuffer);
@@ -635,6 +695,16 @@ inline SFastBuffer S_recv(int s) {
     return buf;
 }
 bool S_sendconsume(int s, SFastBuffer& sendBuffer);
+
+// Sends the contents of `sendBuffer` followed by each of `chunks` with a single scatter-gather call, starting
+// `chunkOffset` bytes into the first chunk, and consumes whatever was sent. Fully sent chunks are removed from the
+// list, and `chunkOffset` is updated for a partially sent one.
+bool S_sendconsume(int s, SFastBuffer& sendBuffer, list<string>& chunks, size_t& chunkOffset);
+
+// The two halves of the scatter-gather `S_sendconsume`, for callers that make the system call some other way.
+// `S_sendvector` fills `iov` with everything waiting to be sent, and `S_sendadvance` consumes `numSent` bytes of it.
+void S_sendvector(const SFastBuffer& sendBuffer, const list<string>& chunks, size_t chunkOffset, vector<iovec>& iov);
+void S_sendadvance(SFastBuffer& sendBuffer, list<string>& chunks, size_t& chunkOffset, size_t numSent);
 int S_poll(fd_map& fdm, uint64_t timeout);
 
 // Network helpers
@@ -800,6 +870,9 @@ struct STestTimer {
 // Networking stuff
 // --------------------------------------------------------------------------
 // Networking includes
+#include "SSlotMap.h"
+#include "SDNSResolver.h"
+#include "SEpoll.h"
 #include "SX509.h"
 #include "SSSLState.h"
 #include "STCPManager.h"
@@ -810,6 +883,8 @@ struct STestTimer {
 // Other libstuff headers.
 #include "SRandom.h"
 #include "SPerformanceTimer.h"
+#include "SThreadPlacement.h"
 #include "SSynchronizedQueue.h"
+#include "SMPSCQueue.h"
 
 #endif	// LIBSTUFF_H
@@ -199,6 +199,9 @@ int main(int argc, char* argv[]) {
     SInitialize("main", (args.isSet("-overrideProcessName") ? args["-overrideProcessName"].c_str() : 0));
     SLogLevel(LOG_INFO);
 
+    // Thread placement has to be set before any other threads start.
+    SThreadPlacement::configure(args["-threadAffinity"]);
+
     if (args.isSet("-version")) {
         // Just output the version
         cout << VERSION << endl;
@@ -236,6 +239,54 @@ int main(int argc, char* argv[]) {
         cout << "-plugins        <list>      Enable these plugins (defaults to 'db,jobs,cache,mysql')" << endl;
         cout << "-cacheSize      <kb>        number of KB to allocate for a page cache (defaults to 1GB)" << endl;
         cout << "-workerThreads  <#>         Number of worker threads to start (min 1, defaults to # of cores)" << endl;
+        cout << "-minWorkerThreads <#>       Fewest worker threads to keep active when the pool adapts to load "
+                "(defaults to -workerThreads)"
+             << endl;
+        cout << "-maxWorkerThreads <#>       Most worker threads to make active under load (defaults to "
+                "-workerThreads, which disables adapting)"
+             << endl;
+        cout << "-clientIOThreads <#>        Number of threads to read and write command port sockets (default 0, "
+                "handled by the main thread)"
+             << endl;
+        cout << "-maxPipelinedRequests <#>   Number of requests a client can have in progress on one connection "
+                "(default 1). Responses are always returned in request order."
+             << endl;
+        cout << "-admissionTargetMS <#>      If commands wait longer than this in the queue, answer new ones with 503 "
+                "rather than queuing them, lowest priority first (default 0, disabled)"
+             << endl;
+        cout << "-fairQueueing               Take turns between flows of commands at the same priority, so one client "
+                "can't starve the others"
+             << endl;
+        cout << "-fairQueueFlowHeader <name> Request header that identifies a command's flow (defaults to the command "
+                "name)"
+             << endl;
+        cout << "-fairQueueWeights <list>    Commands per turn for particular flows, as 'flow:weight,...' (default 1)"
+             << endl;
+        cout << "-deadlineScheduling         Run commands closest to their timeouts first within each priority, and "
+                "answer commands that couldn't finish in time with 503 without running them"
+             << endl;
+        cout << "-singleFlightReads          Answer identical commands that arrive while one is being peeked from that "
+                "one peek"
+             << endl;
+        cout << "-groupCommitWindowUS <#>    Sync commits to disk in groups, waiting this long for more commits to "
+                "share each sync (default 0, each commit syncs on its own)"
+             << endl;
+        cout << "-autoBlacklistConflictRate <rate> Share of a command's worker commits that can conflict before it's "
+                "committed serially instead, until its conflict rate decays (default 0, disabled)"
+             << endl;
+        cout << "-conflictAwareScheduling    Learn which tables each command uses, and hold back commands that often "
+                "conflict while others using the same tables run"
+             << endl;
+        cout << "-threadAffinity <policy>    Pin threads to CPUs by role, as 'role:cpus;...', where roles are sync, "
+                "worker, blockingCommit, replicate, checkpoint, clientIO, and dns, and cpus are a list like '0-3,8' or a "
+                "NUMA node like 'node1', whose memory the threads then prefer"
+             << endl;
+        cout << "-ioBackend      <backend>   How to wait for socket I/O: 'poll' or 'epoll' (default 'epoll')"
+             << endl;
+        cout << "-httpsMaxIdleSocketsPerHost <#> Number of idle connections to keep open to each host that plugins "
+                "make HTTPS requests to, for reuse by later requests (default 4, 0 disables reuse)"
+             << endl;
+        cout << "-httpsIdleSocketTimeoutMS <#> How long an idle HTTPS connection is kept open (default 4000)" << endl;
         cout << "-queryLog       <filename>  Set the query log filename (default 'queryLog.csv', SIGUSR2/SIGQUIT to "
                 "enable/disable)"
              << endl;
@@ -300,6 +351,21 @@ int main(int argc, char* argv[]) {
     SETDEFAULT("-maxJournalSize", "1000000");
     SETDEFAULT("-queryLog", "queryLog.csv");
     SETDEFAULT("-enableMultiWrite", "true");
+    SETDEFAULT("-ioBackend", "epoll");
+
+    // Choose our I/O backend before any sockets are opened.
+    if (SIEquals(args["-ioBackend"], "poll")) {
+        SEpoll::enabled.store(false);
+    } else if (!SIEquals(args["-ioBackend"], "epoll")) {
+        SWARN("Unknown -ioBackend '" << args["-ioBackend"] << "', using epoll.");
+    }
+
+    if (args.isSet("-httpsMaxIdleSocketsPerHost")) {
+        SStandaloneHTTPSManager::maxIdleSocketsPerHost.store(max(0, args.calc("-httpsMaxIdleSocketsPerHost")));
+    }
+    if (args.isSet("-httpsIdleSocketTimeoutMS")) {
+        SStandaloneHTTPSManager::idleSocketTimeoutMS.store(max(0, args.calc("-httpsIdleSocketTimeoutMS")));
+    }
 
     args["-plugins"] = SComposeList(loadPlugins(args));
 
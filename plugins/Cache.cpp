@@ -261,18 +261,16 @@ void BedrockCacheCommand::process(SQLite& db) {
             SASSERT(!name.empty());
 
             // Delete it
-            if (!db.write("DELETE FROM cache WHERE name=" + SQ(name) + ";")) {
+            if (!db.write("DELETE FROM cache WHERE name=?;", {name})) {
                 STHROW("502 Query failed (deleting)");
             }
         }
 
         // Insert the new entry
-        const string& safeValue = SQ(valueHeader.empty() ? request.content : valueHeader);
-        if (!db.write("INSERT OR REPLACE INTO cache ( name, value ) "
-                      "VALUES( " +
-                      SQ(name) + ", " + safeValue + " );")) {
-                          STHROW("502 Query failed (inserting)");
-                      }
+        const string& value = valueHeader.empty() ? request.content : valueHeader;
+        if (!db.write("INSERT OR REPLACE INTO cache ( name, value ) VALUES( ?, ? );", {name, value})) {
+            STHROW("502 Query failed (inserting)");
+        }
 
         // Writing is a form of "use", so this is the new MRU.  Note that we're
         // adding it to the MRU, even before we commit.  So if this transaction
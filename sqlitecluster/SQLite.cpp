@@ -12,6 +12,10 @@ atomic<int> SQLite::fullCheckpointPageMin(25000); // Approx 100mb (pages are ass
 // Tracing can only be enabled or disabled globally, not per object.
 atomic<bool> SQLite::enableTrace(false);
 
+atomic<uint64_t> SQLite::groupCommitWindowUS(0);
+atomic<uint64_t> SQLite::groupCommitCount(0);
+atomic<uint64_t> SQLite::groupCommitSyncs(0);
+
 string SQLite::initializeFilename(const string& filename) {
     // Canonicalize our filename and save that version.
     if (filename == ":memory:") {
@@ -180,6 +184,12 @@ void SQLite::commonConstructorInitialization() {
     } else {
         DBINFO("Using SQLite default PRAGMA synchronous");
     }
+
+    // With group commit, commits are synced together in `_waitForGroupSync` instead.
+    if (groupCommitWindowUS.load()) {
+        DBINFO("Using group commit with a " << groupCommitWindowUS.load() << "us window");
+        SASSERT(!SQuery(_db, "enabling group commit", "PRAGMA synchronous = NORMAL;"));
+    }
 }
 
 SQLite::SQLite(const string& filename, int cacheSize, int maxJournalSize,
@@ -356,6 +366,11 @@ SQLite::~SQLite() {
         SINFO("Rollback in destructor complete.");
     }
 
+    // Statements have to be finalized before the DB can be closed.
+    for (auto& statement : _statements) {
+        sqlite3_finalize(statement.second.statement);
+    }
+
     // Finally, Close the DB.
     DBINFO("Closing database '" << _filename << ".");
     SASSERTWARN(_uncommittedQuery.empty());
@@ -398,6 +413,8 @@ bool SQLite::beginTransaction(TRANSACTION_TYPE type) {
     // the above `BEGIN CONCURRENT` and the `getCommitCount` call in a lock, which is worse.
     _dbCountAtStart = getCommitCount();
     _queryCache.clear();
+    _tablesRead.clear();
+    _tablesWritten.clear();
     _queryCount = 0;
     _cacheHits = 0;
     _beginElapsed = STimeNow() - before;
@@ -508,6 +525,176 @@ bool SQLite::read(const string& query, SQResult& result) {
     return queryResult;
 }
 
+string SQLite::read(const string& query, const vector<Param>& params) {
+    SQResult result;
+    if (!read(query, params, result) || result.empty() || result[0].empty()) {
+        return "";
+    }
+    return result[0][0];
+}
+
+bool SQLite::read(const string& query, const vector<Param>& params, SQResult& result) {
+    uint64_t before = STimeNow();
+    _queryCount++;
+
+    // The query cache is keyed by the query and its parameters, with lengths, so no two sets of them look the same.
+    string key = query;
+    for (const Param& param : params) {
+        uint64_t bits = 0;
+        memcpy(&bits, &param.real, sizeof(bits));
+        const string value = param.type == SQLITE_TEXT ? param.text : to_string(param.integer) + "." + to_string(bits);
+        key += '\0' + to_string(param.type) + ":" + to_string(value.size()) + ":" + value;
+    }
+    auto foundQuery = _queryCache.find(key);
+    if (foundQuery != _queryCache.end()) {
+        result = foundQuery->second;
+        _cacheHits++;
+        return true;
+    }
+    _isDeterministicQuery = true;
+    bool queryResult = !_runQuery(query, params, result);
+    if (_isDeterministicQuery && queryResult) {
+        _queryCache.emplace(make_pair(key, result));
+    }
+    _checkInterruptErrors("SQLite::read"s);
+    _readElapsed += STimeNow() - before;
+    return queryResult;
+}
+
+int SQLite::_runQuery(const string& query, const vector<Param>& params, SQResult& result, string* expandedQuery,
+                      bool skipWarn) {
+    result.clear();
+
+    // Statements prepared with a whitelist or re-writing in effect depend on them, so those aren't kept.
+    const bool cacheable = !whitelist && !_enableRewrite;
+    sqlite3_stmt* statement = nullptr;
+    auto found = cacheable ? _statementIndex.find(query) : _statementIndex.end();
+    if (found != _statementIndex.end()) {
+        // Move it to the front, and note what the authorizer would have if it had been prepared now.
+        _statements.splice(_statements.begin(), _statements, found->second);
+        const CachedStatement& cached = found->second->second;
+        statement = cached.statement;
+        _tablesRead.insert(cached.tablesRead.begin(), cached.tablesRead.end());
+        _tablesWritten.insert(cached.tablesWritten.begin(), cached.tablesWritten.end());
+        _isDeterministicQuery = _isDeterministicQuery && cached.deterministic;
+    } else {
+        // Collect what the authorizer sees while this is prepared separately from the rest of the transaction.
+        set<string> tablesRead;
+        set<string> tablesWritten;
+        swap(tablesRead, _tablesRead);
+        swap(tablesWritten, _tablesWritten);
+        const bool deterministic = _isDeterministicQuery;
+        _isDeterministicQuery = true;
+        const char* tail = nullptr;
+        int error = sqlite3_prepare_v3(_db, query.c_str(), query.size() + 1, cacheable ? SQLITE_PREPARE_PERSISTENT : 0,
+                                       &statement, &tail);
+        CachedStatement prepared = {statement, _tablesRead, _tablesWritten, _isDeterministicQuery};
+        _tablesRead.insert(tablesRead.begin(), tablesRead.end());
+        _tablesWritten.insert(tablesWritten.begin(), tablesWritten.end());
+        _isDeterministicQuery = deterministic && prepared.deterministic;
+        if (error || !statement || (tail && !STrim(tail).empty())) {
+            if (!skipWarn) {
+                SWARN("Couldn't prepare query, error #" << error << " (" << sqlite3_errmsg(_db)
+                      << "), it must be a single statement: " << query);
+            }
+            sqlite3_finalize(statement);
+            return error ? error : SQLITE_MISUSE;
+        }
+        if (cacheable) {
+            _statements.emplace_front(query, move(prepared));
+            _statementIndex[query] = _statements.begin();
+            if (_statements.size() > MAX_CACHED_STATEMENTS) {
+                sqlite3_finalize(_statements.back().second.statement);
+                _statementIndex.erase(_statements.back().first);
+                _statements.pop_back();
+            }
+        }
+    }
+
+    // Bind the parameters.
+    int error = SQLITE_OK;
+    bool hasReal = false;
+    if ((int)params.size() != sqlite3_bind_parameter_count(statement)) {
+        SWARN("Query has " << sqlite3_bind_parameter_count(statement) << " parameters, but was given " << params.size()
+              << " values: " << query);
+        error = SQLITE_RANGE;
+    }
+    for (size_t i = 0; !error && i < params.size(); i++) {
+        const Param& param = params[i];
+        switch (param.type) {
+            case SQLITE_INTEGER:
+                error = sqlite3_bind_int64(statement, i + 1, param.integer);
+                break;
+            case SQLITE_FLOAT:
+                error = sqlite3_bind_double(statement, i + 1, param.real);
+                hasReal = true;
+                break;
+            case SQLITE_TEXT:
+                error = sqlite3_bind_text(statement, i + 1, param.text.data(), param.text.size(), SQLITE_STATIC);
+                break;
+            default:
+                error = sqlite3_bind_null(statement, i + 1);
+                break;
+        }
+    }
+    if (!error && expandedQuery) {
+        char* expanded = sqlite3_expanded_sql(statement);
+        if (expanded) {
+            *expandedQuery = expanded;
+            sqlite3_free(expanded);
+        } else {
+            SWARN("Couldn't expand query: " << query);
+            error = SQLITE_NOMEM;
+        }
+    }
+
+    // Run it. When the expanded query is what will be replayed, and it has reals in it, we run that instead, as
+    // they're written with less precision than they're bound with, and we need to store what will be replayed.
+    uint64_t before = STimeNow();
+    if (!error && expandedQuery && hasReal) {
+        error = SQuery(_db, "expanded query", *expandedQuery, result, 2000 * STIME_US_PER_MS, skipWarn);
+    } else {
+        while (!error) {
+            int stepResult = sqlite3_step(statement);
+            if (stepResult == SQLITE_ROW) {
+                const int columns = sqlite3_column_count(statement);
+                if (result.headers.empty()) {
+                    for (int c = 0; c < columns; c++) {
+                        const char* name = sqlite3_column_name(statement, c);
+                        result.headers.push_back(name ? name : "");
+                    }
+                }
+                result.rows.emplace_back();
+                for (int c = 0; c < columns; c++) {
+                    const char* value = (const char*)sqlite3_column_text(statement, c);
+                    result.rows.back().push_back(value ? string(value, sqlite3_column_bytes(statement, c)) : "");
+                }
+            } else {
+                if (stepResult != SQLITE_DONE) {
+                    error = stepResult;
+                    if (!skipWarn) {
+                        SWARN("Query failed with error #" << error << " (" << sqlite3_errmsg(_db) << "): " << query);
+                    }
+                }
+                break;
+            }
+        }
+    }
+    uint64_t elapsed = STimeNow() - before;
+    if (elapsed > 2000 * STIME_US_PER_MS) {
+        SWARN("Slow query (" << elapsed / 1000 << "ms): " << query);
+    }
+
+    // Leave the statement ready for next time, or get rid of it if it's not being kept.
+    if (cacheable) {
+        sqlite3_reset(statement);
+        sqlite3_clear_bindings(statement);
+    } else {
+        sqlite3_finalize(statement);
+    }
+    return error;
+}
+
 void SQLite::_checkInterruptErrors(const string& error) {
 
     // Local error code.
@@ -559,18 +746,30 @@ bool SQLite::write(const string& query) {
     }
 
     // This is literally identical to the idempotent version except for the check for _noopUpdateMode.
-    return _writeIdempotent(query);
+    return _writeIdempotent(query, {});
 }
 
 bool SQLite::writeIdempotent(const string& query) {
-    return _writeIdempotent(query);
+    return _writeIdempotent(query, {});
 }
 
 bool SQLite::writeUnmodified(const string& query) {
-    return _writeIdempotent(query, true);
+    return _writeIdempotent(query, {}, true);
+}
+
+bool SQLite::write(const string& query, const vector<Param>& params) {
+    if (_noopUpdateMode) {
+        SALERT("Non-idempotent write in _noopUpdateMode. Query: " << query);
+        return true;
+    }
+    return _writeIdempotent(query, params);
 }
 
-bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
+bool SQLite::writeIdempotent(const string& query, const vector<Param>& params) {
+    return _writeIdempotent(query, params);
+}
+
+bool SQLite::_writeIdempotent(const string& query, const vector<Param>& params, bool alwaysKeepQueries) {
     SASSERT(_insideTransaction);
     _queryCache.clear();
     _queryCount++;
@@ -584,12 +783,20 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
     uint64_t schemaBefore = SToUInt64(results[0][0]);
     uint64_t changesBefore = sqlite3_total_changes(_db);
 
-    // Try to execute the query
+    // Try to execute the query. With parameters, it's the query with them filled in that we keep.
     uint64_t before = STimeNow();
     bool usedRewrittenQuery = false;
     int resultCode = 0;
+    string expandedQuery;
+    auto execute = [&](bool skipWarn) {
+        if (params.empty()) {
+            return SQuery(_db, "read/write transaction", query, 2000 * STIME_US_PER_MS, skipWarn);
+        }
+        SQResult ignore;
+        return _runQuery(query, params, ignore, &expandedQuery, skipWarn);
+    };
     if (_enableRewrite) {
-        resultCode = SQuery(_db, "read/write transaction", query, 2000 * STIME_US_PER_MS, true);
+        resultCode = execute(true);
         if (resultCode == SQLITE_AUTH) {
             // Run re-written query.
             _currentlyRunningRewritten = true;
@@ -599,7 +806,7 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
             _currentlyRunningRewritten = false;
         }
     } else {
-        resultCode = SQuery(_db, "read/write transaction", query);
+        resultCode = execute(false);
     }
 
     // If we got a constraints error, throw that.
@@ -621,7 +828,7 @@ bool SQLite::_writeIdempotent(const string& query, bool alwaysKeepQueries) {
 
     // If something changed, or we're always keeping queries, then save this.
     if (alwaysKeepQueries || (schemaAfter > schemaBefore) || (changesAfter > changesBefore)) {
-        _uncommittedQuery += usedRewrittenQuery ? _rewrittenQuery : query;
+        _uncommittedQuery += usedRewrittenQuery ? _rewrittenQuery : (params.empty() ? query : expandedQuery);
     }
     return true;
 }
@@ -745,6 +952,7 @@ int SQLite::commit(const string& description) {
         _commitElapsed += STimeNow() - before;
         _journalSize = newJournalSize;
         _sharedData.incrementCommit(_uncommittedHash);
+        const uint64_t commitID = _sharedData.commitCount.load();
         _insideTransaction = false;
         _uncommittedHash.clear();
         _uncommittedQuery.clear();
@@ -760,6 +968,14 @@ int SQLite::commit(const string& description) {
         }
         _sharedData.blockNewTransactionsCV.notify_one();
 
+        // Now that other transactions can commit, wait until this one's durable. Those that commit in the meantime
+        // can share the same sync.
+        if (groupCommitWindowUS.load()) {
+            uint64_t beforeSync = STimeNow();
+            _waitForGroupSync(commitID);
+            _commitElapsed += STimeNow() - beforeSync;
+        }
+
         // See if we can checkpoint without holding the commit lock.
         if (!_sharedData._checkpointThreadBusy) {
             int walSizeFrames = 0;
@@ -793,6 +1009,38 @@ int SQLite::commit(const string& description) {
     return result;
 }
 
+void SQLite::_waitForGroupSync(uint64_t commitID) {
+    groupCommitCount++;
+    unique_lock<mutex> lock(_sharedData.groupSyncMutex);
+    while (_sharedData.syncedCommitCount < commitID) {
+        if (_sharedData.groupSyncInProgress) {
+            // Another handle is syncing. If it started before we committed, we'll need another one after it.
+            _sharedData.groupSyncCV.wait(lock);
+            continue;
+        }
+
+        // Nobody's syncing, so we do it for everybody. Every commit that's finished by the time we sync has written
+        // its frames to the WAL file, and is covered, whichever handle wrote them.
+        _sharedData.groupSyncInProgress = true;
+        lock.unlock();
+        usleep(groupCommitWindowUS.load());
+        const uint64_t syncedThrough = _sharedData.commitCount.load();
+        sqlite3_file* wal = nullptr;
+        sqlite3_file_control(_db, "main", SQLITE_FCNTL_JOURNAL_POINTER, &wal);
+        if (wal && wal->pMethods) {
+            int result = wal->pMethods->xSync(wal, SQLITE_SYNC_NORMAL);
+            if (result != SQLITE_OK) {
+                SERROR("Couldn't sync WAL file through commit " << syncedThrough << ", got result: " << result);
+            }
+        }
+        groupCommitSyncs++;
+        lock.lock();
+        _sharedData.syncedCommitCount = max(_sharedData.syncedCommitCount, syncedThrough);
+        _sharedData.groupSyncInProgress = false;
+        _sharedData.groupSyncCV.notify_all();
+    }
+}
+
 map<uint64_t, tuple<string, string, uint64_t>> SQLite::popCommittedTransactions() {
     return _sharedData.popCommittedTransactions();
 }
@@ -962,6 +1210,15 @@ int SQLite::_authorize(int actionCode, const char* detail1, const char* detail2,
         }
     }
 
+    // Note which tables the transaction uses, so callers can tell which transactions might conflict. We only search
+    // the journal names for tables that could be one of them.
+    if ((actionCode == SQLITE_READ || actionCode == SQLITE_INSERT || actionCode == SQLITE_UPDATE ||
+         actionCode == SQLITE_DELETE) && detail1 && strncmp(detail1, "sqlite_", 7) &&
+        (strncmp(detail1, "journal", 7) ||
+         find(_journalNames.begin(), _journalNames.end(), detail1) == _journalNames.end())) {
+        (actionCode == SQLITE_READ ? _tablesRead : _tablesWritten).emplace(detail1);
+    }
+
     // If the whitelist isn't set, we always return OK.
     if (!whitelist) {
         return SQLITE_OK;
@@ -1101,7 +1358,9 @@ _commitEnabled(true),
 _commitLockTimer("commit lock timer", {
     {"EXCLUSIVE", chrono::steady_clock::duration::zero()},
     {"SHARED", chrono::steady_clock::duration::zero()},
-})
+}),
+syncedCommitCount(0),
+groupSyncInProgress(false)
 { }
 
 void SQLite::SharedData::setCommitEnabled(bool enable) {
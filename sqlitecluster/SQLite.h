@@ -97,6 +97,29 @@ class SQLite {
     // Performs a read-only query (eg, SELECT) that returns a single value.
     string read(const string& query);
 
+    // A value for a `?` parameter in a query.
+    class Param {
+      public:
+        template<typename T, typename = enable_if_t<is_integral_v<T>>>
+        Param(T value) : type(SQLITE_INTEGER), integer(value), real(0) {}
+        Param(double value) : type(SQLITE_FLOAT), integer(0), real(value) {}
+        Param(const string& value) : type(SQLITE_TEXT), integer(0), real(0), text(value) {}
+        Param(const char* value) : Param(string(value)) {}
+        Param(nullptr_t) : type(SQLITE_NULL), integer(0), real(0) {}
+
+        // One of SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT or SQLITE_NULL, saying which value is set.
+        int type;
+        int64_t integer;
+        double real;
+        string text;
+    };
+
+    // These are the same as `read` above, except that `query` is a single statement with a `?` in place of each value
+    // in `params`, which are bound to it rather than written into it. The statement is prepared once and kept (see
+    // `MAX_CACHED_STATEMENTS`), so queries that run often aren't parsed and planned again each time.
+    bool read(const string& query, const vector<Param>& params, SQResult& result);
+    string read(const string& query, const vector<Param>& params);
+
     // Types of transactions that we can begin.
     enum class TRANSACTION_TYPE {
         SHARED,
@@ -135,6 +158,14 @@ class SQLite {
     // to the journal *even if they have no effect* on the rest of the database.
     bool writeUnmodified(const string& query);
 
+    // These are the same as `write` and `writeIdempotent`, but with parameters like `read` above. The query is written
+    // to the journal with the parameters filled in, as if it had been written without them.
+    bool write(const string& query, const vector<Param>& params);
+    bool writeIdempotent(const string& query, const vector<Param>& params);
+
+    // The most prepared statements for queries with parameters that each handle keeps.
+    static constexpr size_t MAX_CACHED_STATEMENTS = 200;
+
     // Enable or disable update-noop mode.
     void setUpdateNoopMode(bool enabled);
     bool getUpdateNoopMode() const;
@@ -196,6 +227,11 @@ class SQLite {
     // transaction.
     string getUncommittedQuery() { return _uncommittedQuery; }
 
+    // Returns the tables read and written by the current transaction, or the last one if none is in progress, going
+    // by what the authorizer was asked to allow. The journal and SQLite's own tables aren't included.
+    const set<string>& getTablesRead() const { return _tablesRead; }
+    const set<string>& getTablesWritten() const { return _tablesWritten; }
+
     // Gets the ROWID of the last insertion (for auto-increment indexes)
     int64_t getLastInsertRowID();
 
@@ -248,6 +284,16 @@ class SQLite {
     // Enable/disable SQL statement tracing.
     static atomic<bool> enableTrace;
 
+    // Group commit. If this is non-zero when a handle is opened, it uses `PRAGMA synchronous = NORMAL`, so its commits
+    // don't sync the WAL file themselves. Instead, `commit` waits until a sync that started after it committed has
+    // finished. Whichever committer starts a sync first waits this long, so that commits made in the meantime can
+    // share it, and everything committed by then is made durable with one sync.
+    static atomic<uint64_t> groupCommitWindowUS;
+
+    // The number of commits that waited for a group sync, and the number of syncs they shared.
+    static atomic<uint64_t> groupCommitCount;
+    static atomic<uint64_t> groupCommitSyncs;
+
     // Calling this before starting a transaction will prevent the next transaction from being interrupted by a restart
     // checkpoint and restarting. This causes a potential performance issue so only do this if it's *really important*
     // that this transaction isn't interrupted. The primary reason for adding this was to enable slow but very
@@ -336,6 +382,13 @@ class SQLite {
 
         SPerformanceTimer _commitLockTimer;
 
+        // Group commit state. Every commit through `syncedCommitCount` has been synced to disk, and
+        // `groupSyncInProgress` is set while a handle is syncing for the group.
+        mutex groupSyncMutex;
+        condition_variable groupSyncCV;
+        uint64_t syncedCommitCount;
+        bool groupSyncInProgress;
+
       private:
         // The data required to replicate transactions, in two lists, depending on whether this has only been prepared
         // or if it's been committed.
@@ -408,7 +461,23 @@ class SQLite {
     // locked (i.e., this is `false` if some other DB object has locked the mutex).
     bool _mutexLocked = false;
 
-    bool _writeIdempotent(const string& query, bool alwaysKeepQueries = false);
+    bool _writeIdempotent(const string& query, const vector<Param>& params, bool alwaysKeepQueries = false);
+
+    // Runs a query with parameters, using a cached statement if there is one. If `expandedQuery` is set, it's set to
+    // `query` with the parameters filled in. Returns an SQLite result code.
+    int _runQuery(const string& query, const vector<Param>& params, SQResult& result, string* expandedQuery = nullptr,
+                  bool skipWarn = false);
+
+    // Prepared statements for queries with parameters, most recently used first, and indexed by query. Along with
+    // each one, we keep what the authorizer told us when it was prepared, as it isn't asked again when it's reused.
+    struct CachedStatement {
+        sqlite3_stmt* statement;
+        set<string> tablesRead;
+        set<string> tablesWritten;
+        bool deterministic;
+    };
+    list<pair<string, CachedStatement>> _statements;
+    map<string, list<pair<string, CachedStatement>>::iterator> _statementIndex;
 
     // Constructs a UNION query from a list of 'query parts' over each of our journal tables.
     // Fore each table, queryParts will be joined with that table's name as a separator. I.e., if you have a tables
@@ -469,6 +538,10 @@ class SQLite {
     // We check them all together because we need to make sure we atomically pick a single one to handle.
     void _checkInterruptErrors(const string& error);
 
+    // Waits until commit `commitID` has been synced to disk, doing the sync for everyone if nobody else is. See
+    // `groupCommitWindowUS`.
+    void _waitForGroupSync(uint64_t commitID);
+
     // Called internally by _sqliteAuthorizerCallback to authorize columns for a query.
     int _authorize(int actionCode, const char* detail1, const char* detail2, const char* detail3, const char* detail4);
 
@@ -498,6 +571,10 @@ class SQLite {
     // Will be set to false while running a non-deterministic query to prevent it's result being cached.
     bool _isDeterministicQuery = false;
 
+    // The tables touched by the current transaction. See `getTablesRead` and `getTablesWritten`.
+    set<string> _tablesRead;
+    set<string> _tablesWritten;
+
     bool _pageLoggingEnabled;
     static atomic<int64_t> _transactionAttemptCount;
     static mutex _pageLogMutex;
@@ -22,6 +22,9 @@ SData SQLiteCommand::preprocessRequest(SData&& request) {
 SQLiteCommand::SQLiteCommand(SData&& _request) : 
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientSequence(0),
+    initiatingClientOwner(0),
+    initiatingClientBinary(false),
     request(preprocessRequest(move(_request))),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
@@ -51,6 +54,9 @@ SQLiteCommand::SQLiteCommand(SData&& _request) :
 SQLiteCommand::SQLiteCommand() :
     initiatingPeerID(0),
     initiatingClientID(0),
+    initiatingClientSequence(0),
+    initiatingClientOwner(0),
+    initiatingClientBinary(false),
     writeConsistency(SQLiteNode::ASYNC),
     complete(false),
     escalationTimeUS(0),
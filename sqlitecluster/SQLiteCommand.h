@@ -23,6 +23,17 @@ class SQLiteCommand {
     // can't respond to.
     int64_t initiatingClientID;
 
+    // A client may pipeline several requests on a single connection. This is the position of this command's request
+    // among those read from `initiatingClientID`, so that responses can be returned in the same order.
+    uint64_t initiatingClientSequence;
+
+    // Identifies which of the server's threads owns the socket for `initiatingClientID`, so the response can be handed
+    // to that thread to send.
+    size_t initiatingClientOwner;
+
+    // True if `initiatingClientID` sent this command as a binary frame, and so expects its response as one.
+    bool initiatingClientBinary;
+
     // Each command is given a unique id that can be serialized and passed back and forth across nodes. Its id must be
     // uniquely identifiable for cases where, for instance, two peers escalate commands to the leader, and leader will
     // need to  respond to them.
@@ -404,6 +404,9 @@ void SQLiteNode::_sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs
         return;
     }
     string sendTime = to_string(STimeNow());
+
+    // However many transactions there are, they go to each peer in a single write.
+    string batch;
     for (auto& i : transactions) {
         uint64_t id = i.first;
         if (id <= _lastSentTransactionID) {
@@ -430,7 +433,7 @@ void SQLiteNode::_sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs
                 // Clear the response flag from the last transaction
                 peer->transactionResponse = Peer::Response::NONE;
             }
-            _sendToAllPeers(transaction, true); // subscribed only
+            batch += _serializeForPeers(transaction);
         } else {
             SINFO("Sending COMMIT for QUORUM transaction " << idHeader << " to followers");
         }
@@ -438,9 +441,12 @@ void SQLiteNode::_sendOutstandingTransactions(const set<uint64_t>& commitOnlyIDs
         commit["ID"] = idHeader;
         commit["NewCount"] = to_string(id);
         commit["NewHash"] = hash;
-        _sendToAllPeers(commit, true); // subscribed only
+        batch += _serializeForPeers(commit);
         _lastSentTransactionID = id;
     }
+    if (!batch.empty()) {
+        _sendSerializedToAllPeers(batch, true); // subscribed only
+    }
 }
 
 void SQLiteNode::escalateCommand(unique_ptr<SQLiteCommand>&& command, bool forget) {
@@ -1978,7 +1984,12 @@ void SQLiteNode::_sendToPeer(Peer* peer, const SData& message) {
 }
 
 void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
-    // Piggyback on whatever we're sending to add the CommitCount/Hash, but only serialize once before broadcasting.
+    // Only serialize once before broadcasting.
+    _sendSerializedToAllPeers(_serializeForPeers(message), subscribedOnly);
+}
+
+string SQLiteNode::_serializeForPeers(const SData& message) {
+    // Piggyback on whatever we're sending to add the CommitCount/Hash.
     SData messageCopy = message;
     if (!messageCopy.isSet("CommitCount")) {
         messageCopy["CommitCount"] = SToStr(_db.getCommitCount());
@@ -1986,14 +1997,16 @@ void SQLiteNode::_sendToAllPeers(const SData& message, bool subscribedOnly) {
     if (!messageCopy.isSet("Hash")) {
         messageCopy["Hash"] = _db.getCommittedHash();
     }
-    const string& serializedMessage = messageCopy.serialize();
+    return messageCopy.serialize();
+}
 
+void SQLiteNode::_sendSerializedToAllPeers(const string& serializedMessages, bool subscribedOnly) {
     // Loop across all connected peers and send the message
     for (auto peer : peerList) {
         // Send either to everybody, or just subscribed peers.
         if (peer->socket && (!subscribedOnly || peer->subscribed)) {
             // Send it now, without waiting for the outer event loop
-            peer->socket->send(serializedMessage);
+            peer->socket->send(serializedMessages);
         }
     }
 }
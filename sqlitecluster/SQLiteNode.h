@@ -179,6 +179,11 @@ class SQLiteNode : public STCPNode {
     // Helper methods
     void _sendToPeer(Peer* peer, const SData& message);
     void _sendToAllPeers(const SData& message, bool subscribedOnly = false);
+
+    // Serializes `message` as `_sendToAllPeers` would send it, and sends already serialized messages to all peers.
+    // Together, these let us send several messages to each peer in one write.
+    string _serializeForPeers(const SData& message);
+    void _sendSerializedToAllPeers(const string& serializedMessages, bool subscribedOnly);
     void _changeState(State newState);
 
     // Queue a SYNCHRONIZE message based on the current state of the node, thread-safe, but you need to pass the
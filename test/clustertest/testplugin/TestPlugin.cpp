@@ -202,6 +202,9 @@ bool TestPluginCommand::peek(SQLite& db) {
                 host = "www.google.com";
             }
             newRequest["Host"] = host;
+            if (request.isSet("httpsConnection")) {
+                newRequest["Connection"] = request["httpsConnection"];
+            }
             httpsRequests.push_back(plugin().httpsManager->send("https://" + host + "/", newRequest));
         }
         return false; // Not complete.
@@ -0,0 +1,52 @@
+#include "../BedrockClusterTester.h"
+
+struct ConflictAwareSchedulingTest : tpunit::TestFixture {
+    ConflictAwareSchedulingTest()
+        : tpunit::TestFixture("ConflictAwareSchedulingTest",
+                              BEFORE_CLASS(ConflictAwareSchedulingTest::setup),
+                              AFTER_CLASS(ConflictAwareSchedulingTest::teardown),
+                              TEST(ConflictAwareSchedulingTest::test)) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0,
+                                          {{"-conflictAwareScheduling", "true"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void test() {
+        BedrockTester& leader = tester->getTester(0);
+
+        // Every `idcollision` reads and writes the same table, so these conflict with each other whenever they run at
+        // once. Once the leader's seen that, it should start holding them back instead, and they should all succeed.
+        list<thread> threads;
+        atomic<int> failures(0);
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back([&leader, &failures, i]() {
+                vector<SData> requests;
+                for (int j = 0; j < 100; j++) {
+                    SData query("idcollision");
+                    query["writeConsistency"] = "ASYNC";
+                    query["value"] = "sent-" + to_string(i) + "-" + to_string(j);
+                    requests.push_back(query);
+                }
+                for (const auto& result : leader.executeWaitMultipleData(requests)) {
+                    if (SToInt(result.methodLine) != 200) {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        ASSERT_EQUAL(failures.load(), 0);
+
+        STable status = SParseJSONObject(leader.executeWaitVerifyContent(SData("Status")));
+        ASSERT_GREATER_THAN(SToInt(status["conflictAwareWaits"]), 0);
+    }
+} __ConflictAwareSchedulingTest;
@@ -1,12 +1,13 @@
 #include "../BedrockClusterTester.h"
 
 struct ConflictSpamTest : tpunit::TestFixture {
-    ConflictSpamTest()
-        : tpunit::TestFixture("ConflictSpam",
+    ConflictSpamTest(const char* name, const map<string, string>& serverArgs = {})
+        : tpunit::TestFixture(name,
                               BEFORE_CLASS(ConflictSpamTest::setup),
                               AFTER_CLASS(ConflictSpamTest::teardown),
                               TEST(ConflictSpamTest::slow),
-                              TEST(ConflictSpamTest::spam)) { }
+                              TEST(ConflictSpamTest::spam)),
+          args(serverArgs) { }
 
     /* What's a conflict spam test? The main point of this test is to make sure we have lots of conflicting commits
      * coming in to the whole cluster, so that we can make sure they all eventually get committed and replicated in a
@@ -17,12 +18,15 @@ struct ConflictSpamTest : tpunit::TestFixture {
     BedrockClusterTester* tester;
     atomic<int> cmdID;
 
+    // Extra arguments for every node. With none, these commands all run in parallel, and conflict with each other.
+    map<string, string> args;
+
     void setup() {
         cmdID.store(0);
 
         // Turn the settings for checkpointing way down so we can observe that both passive and full checkpoints
         // happen as expected.
-        tester = new BedrockClusterTester();
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, args);
         for (int i = 0; i < 3; i++) {
             BedrockTester& node = tester->getTester(i);
             SData controlCommand("SetCheckpointIntervals");
@@ -126,6 +130,16 @@ struct ConflictSpamTest : tpunit::TestFixture {
         }
         threads.clear();
 
+        // If the automatic blacklist is on, the leader should have kept conflict statistics for the command.
+        if (args.count("-autoBlacklistConflictRate")) {
+            STable status = SParseJSONObject(tester->getTester(0).executeWaitVerifyContent(SData("Status")));
+            bool found = false;
+            for (const string& command : SParseJSONArray(status["multiWriteAutoBlacklist"])) {
+                found |= SParseJSONObject(command)["command"] == "idcollision b2";
+            }
+            ASSERT_TRUE(found);
+        }
+
         // Let's collect the names of the journal tables on each node.
         vector <string> allResults(3);
         for (int i : {0, 1, 2}) {
@@ -308,4 +322,7 @@ struct ConflictSpamTest : tpunit::TestFixture {
         ASSERT_EQUAL(fail, 0);
     }
 
-} __ConflictSpamTest;
+};
+
+ConflictSpamTest __ConflictSpamTest("ConflictSpam");
+ConflictSpamTest __ConflictSpamAutoBlacklistTest("ConflictSpamAutoBlacklist", {{"-autoBlacklistConflictRate", "0.25"}});
@@ -0,0 +1,64 @@
+#include "../BedrockClusterTester.h"
+
+struct GroupCommitTest : tpunit::TestFixture {
+    GroupCommitTest()
+        : tpunit::TestFixture("GroupCommitTest",
+                              BEFORE_CLASS(GroupCommitTest::setup),
+                              AFTER_CLASS(GroupCommitTest::teardown),
+                              TEST(GroupCommitTest::test)) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-groupCommitWindowUS", "1000"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void test() {
+        // Lots of writes at once, from several clients.
+        list<thread> threads;
+        atomic<int> failures(0);
+        for (int i = 0; i < 4; i++) {
+            threads.emplace_back([this, &failures, i]() {
+                vector<SData> requests;
+                for (int j = 0; j < 100; j++) {
+                    SData query("Query");
+                    query["writeConsistency"] = "ASYNC";
+                    query["query"] = "INSERT INTO test VALUES(" + SQ(100'000 + i * 1000 + j) + ", " + SQ("group") + ");";
+                    requests.push_back(query);
+                }
+                for (const auto& result : tester->getTester(0).executeWaitMultipleData(requests)) {
+                    if (SToInt(result.methodLine) != 200) {
+                        failures++;
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        ASSERT_EQUAL(failures.load(), 0);
+
+        // Every commit waited for a sync, but they shouldn't have needed one each.
+        STable status = SParseJSONObject(tester->getTester(0).executeWaitVerifyContent(SData("Status")));
+        ASSERT_GREATER_THAN_EQUAL(SToUInt64(status["groupCommitCount"]), 400);
+        ASSERT_LESS_THAN(SToUInt64(status["groupCommitSyncs"]), SToUInt64(status["groupCommitCount"]));
+
+        // And they should all have been replicated.
+        for (int i : {1, 2}) {
+            SData query("Query");
+            query["query"] = "SELECT COUNT(*) FROM test WHERE value = 'group';";
+            bool replicated = false;
+            for (int tries = 0; tries < 50 && !replicated; tries++) {
+                replicated = SContains(tester->getTester(i).executeWaitVerifyContent(query), "400");
+                if (!replicated) {
+                    usleep(100'000);
+                }
+            }
+            ASSERT_TRUE(replicated);
+        }
+    }
+} __GroupCommitTest;
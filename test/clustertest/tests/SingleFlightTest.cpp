@@ -0,0 +1,40 @@
+#include "../BedrockClusterTester.h"
+
+struct SingleFlightTest : tpunit::TestFixture {
+    SingleFlightTest()
+        : tpunit::TestFixture("SingleFlightTest",
+                              BEFORE_CLASS(SingleFlightTest::setup),
+                              AFTER_CLASS(SingleFlightTest::teardown),
+                              TEST(SingleFlightTest::test)) { }
+
+    BedrockClusterTester* tester;
+
+    void setup() {
+        tester = new BedrockClusterTester(ClusterSize::THREE_NODE_CLUSTER, {}, 0, {{"-singleFlightReads", "true"}});
+    }
+
+    void teardown() {
+        delete tester;
+    }
+
+    void test() {
+        BedrockTester& leader = tester->getTester(0);
+
+        // Send the same slow read from several clients at once. They should all get the same answer, but most of them
+        // shouldn't have to run it.
+        list<thread> threads;
+        for (int i = 0; i < 8; i++) {
+            threads.emplace_back([&leader]() {
+                SData slow("slowquery");
+                slow["size"] = "10000000";
+                leader.executeWaitVerifyContent(slow);
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        STable status = SParseJSONObject(leader.executeWaitVerifyContent(SData("Status")));
+        ASSERT_GREATER_THAN(SToInt(status["singleFlightMerged"]), 0);
+    }
+} __SingleFlightTest;
@@ -0,0 +1,40 @@
+#include <libstuff/libstuff.h>
+#include <BedrockCommandQueue.h>
+#include <test/lib/BedrockTester.h>
+
+struct BedrockCommandQueueTest : tpunit::TestFixture {
+    BedrockCommandQueueTest()
+        : tpunit::TestFixture("BedrockCommandQueue",
+                              TEST(BedrockCommandQueueTest::standingDelay)) { }
+
+    unique_ptr<BedrockCommand> makeCommand(const string& methodLine) {
+        return make_unique<BedrockCommand>(SQLiteCommand(SData(methodLine)), nullptr);
+    }
+
+    void standingDelay() {
+        BedrockCommandQueue queue;
+        ASSERT_EQUAL(queue.standingDelay(), 0);
+
+        // Commands that all wait a while before being dequeued give us a standing delay once the interval is over.
+        for (int i = 0; i < 3; i++) {
+            queue.push(makeCommand("Slow"));
+        }
+        usleep(50'000);
+        while (!queue.empty()) {
+            queue.get();
+        }
+        usleep(BedrockCommandQueue::SOJOURN_INTERVAL_US);
+        uint64_t delay = queue.standingDelay();
+        ASSERT_GREATER_THAN_EQUAL(delay, 50'000);
+
+        // But a single command that goes straight through in the next interval shows the backlog is gone.
+        queue.push(makeCommand("Fast"));
+        queue.get();
+        usleep(BedrockCommandQueue::SOJOURN_INTERVAL_US);
+        ASSERT_LESS_THAN(queue.standingDelay(), 50'000);
+
+        // And once nothing's dequeued for a whole interval with the queue empty, there's no delay at all.
+        usleep(BedrockCommandQueue::SOJOURN_INTERVAL_US);
+        ASSERT_EQUAL(queue.standingDelay(), 0);
+    }
+} __BedrockCommandQueueTest;
@@ -24,7 +24,16 @@ struct LibStuff : tpunit::TestFixture {
                                     TEST(LibStuff::testRandom),
                                     TEST(LibStuff::testHexConversion),
                                     TEST(LibStuff::testBase32Conversion),
-                                    TEST(LibStuff::testContains))
+                                    TEST(LibStuff::testContains),
+                                    TEST(LibStuff::testPoll),
+                                    TEST(LibStuff::testScatterGatherSend),
+                                    TEST(LibStuff::testFastBuffer),
+                                    TEST(LibStuff::testIncrementalHTTPParse),
+                                    TEST(LibStuff::testSlotMap),
+                                    TEST(LibStuff::testMPSCQueue),
+                                    TEST(LibStuff::testBinarySData),
+                                    TEST(LibStuff::testDNSResolver),
+                                    TEST(LibStuff::testThreadPlacement))
     { }
 
     void testEncryptDecrpyt() {
@@ -594,4 +603,378 @@ struct LibStuff : tpunit::TestFixture {
         ASSERT_TRUE(SContains(string("asdf"), "a"));
         ASSERT_TRUE(SContains(string("asdf"), string("asd")));
     }
+
+    void testPoll() {
+        int fds[2];
+        ASSERT_EQUAL(pipe(fds), 0);
+
+        // Nothing to read yet.
+        fd_map fdm;
+        SFDset(fdm, fds[0], SREADEVTS);
+        ASSERT_EQUAL(S_poll(fdm, 0), 0);
+        ASSERT_FALSE(SFDAnySet(fdm, fds[0], SREADEVTS));
+
+        // Now there is.
+        ASSERT_EQUAL(write(fds[1], "x", 1), 1);
+        ASSERT_EQUAL(S_poll(fdm, 0), 1);
+        ASSERT_TRUE(SFDAnySet(fdm, fds[0], SREADEVTS));
+
+        // An epoll set is ready when anything registered with it is, so it can be polled in place of all of them, and
+        // it then reports only the ones that are ready.
+        SEpoll epoll;
+        ASSERT_TRUE(epoll.valid());
+        int idle[2];
+        ASSERT_EQUAL(pipe(idle), 0);
+        ASSERT_TRUE(epoll.set(idle[0], SREADEVTS));
+        ASSERT_TRUE(epoll.set(fds[0], SREADEVTS));
+        fdm.clear();
+        SFDset(fdm, epoll.fd(), SREADEVTS);
+        ASSERT_EQUAL(S_poll(fdm, 0), 1);
+        ASSERT_TRUE(SFDAnySet(fdm, epoll.fd(), SREADEVTS));
+        ASSERT_EQUAL(epoll.wait(fdm, 0), 1);
+        ASSERT_TRUE(SFDAnySet(fdm, fds[0], SREADEVTS));
+        ASSERT_FALSE(SFDAnySet(fdm, idle[0], SREADEVTS));
+
+        // Changing what a descriptor's registered for takes effect without registering it again, and once it's
+        // removed it isn't reported at all.
+        ASSERT_TRUE(epoll.set(fds[1], SWRITEEVTS));
+        fdm.clear();
+        ASSERT_EQUAL(epoll.wait(fdm, 0), 2);
+        ASSERT_TRUE(SFDAnySet(fdm, fds[1], SWRITEEVTS));
+        epoll.remove(fds[0]);
+        epoll.remove(fds[1]);
+        fdm.clear();
+        ASSERT_EQUAL(epoll.wait(fdm, 0), 0);
+        ASSERT_TRUE(fdm.empty());
+
+        for (int fd : {fds[0], fds[1], idle[0], idle[1]}) {
+            close(fd);
+        }
+    }
+
+    void testScatterGatherSend() {
+        // Serializing in parts should give the same message as serializing all at once, without the content.
+        SData response("200 OK");
+        response["name"] = "value";
+        response.content = "some content";
+        string whole = response.serialize();
+        string headers, body;
+        response.serialize(headers, body);
+        ASSERT_EQUAL(headers + body, whole);
+        ASSERT_EQUAL(body, "some content");
+        ASSERT_TRUE(response.content.empty());
+
+        // Send a buffer followed by chunks, skipping the part of the first chunk that was already sent.
+        int fds[2];
+        ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        SFastBuffer sendBuffer("a");
+        list<string> chunks = {"xbc", "", "def"};
+        size_t chunkOffset = 1;
+        ASSERT_TRUE(S_sendconsume(fds[0], sendBuffer, chunks, chunkOffset));
+        ASSERT_TRUE(sendBuffer.empty());
+        ASSERT_TRUE(chunks.empty());
+        ASSERT_EQUAL(chunkOffset, 0);
+        char received[10] = {};
+        ASSERT_EQUAL(read(fds[1], received, sizeof(received)), 6);
+        ASSERT_EQUAL(string(received), "abcdef");
+        close(fds[0]);
+        close(fds[1]);
+
+        // A string sent while chunks are only partly sent has to go out after them.
+        ASSERT_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+        const string chunk(4 * 1024 * 1024, 'x');
+        STCPManager::Socket socket(fds[0], STCPManager::Socket::CONNECTED);
+        ASSERT_TRUE(socket.send(list<string>{chunk}));
+        ASSERT_FALSE(socket.sendBufferEmpty());
+        ASSERT_TRUE(socket.send("tail"));
+        string all;
+        char buffer[64 * 1024];
+        while (all.size() < chunk.size() + 4) {
+            ASSERT_TRUE(socket.send());
+            ssize_t bytes = read(fds[1], buffer, sizeof(buffer));
+            ASSERT_GREATER_THAN(bytes, 0);
+            all.append(buffer, bytes);
+        }
+        ASSERT_TRUE(all == chunk + "tail");
+        close(fds[1]);
+    }
+
+    void testFastBuffer() {
+        SFastBuffer buffer;
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_EQUAL(string(buffer.c_str()), "");
+
+        // Compare against a plain string as we append and consume.
+        string expected;
+        for (int i = 0; i < 1000; i++) {
+            string chunk(i % 17 + 1, 'a' + i % 26);
+            buffer += chunk;
+            expected += chunk;
+            buffer.consumeFront(i % 5);
+            expected.erase(0, i % 5);
+        }
+        ASSERT_EQUAL(string(buffer.c_str(), buffer.size()), expected);
+
+        // Contents stay null-terminated.
+        ASSERT_EQUAL(strlen(buffer.c_str()), buffer.size());
+
+        // Copies and moves.
+        SFastBuffer copy(buffer);
+        ASSERT_EQUAL(string(copy.c_str(), copy.size()), expected);
+        SFastBuffer moved(move(copy));
+        ASSERT_TRUE(copy.empty());
+        ASSERT_EQUAL(string(moved.c_str(), moved.size()), expected);
+
+        // Contents that span many chunks read back the same, whether gathered chunk by chunk or joined together, and
+        // keep doing so as more is appended after joining them.
+        for (int i = 0; i < 100; i++) {
+            string chunk(i * 97 % 5000 + 1, 'a' + i % 26);
+            buffer += chunk;
+            expected += chunk;
+            buffer.consumeFront(i * 31 % 700);
+            expected.erase(0, i * 31 % 700);
+            if (i % 10 == 0) {
+                vector<iovec> iov;
+                buffer.gather(iov);
+                string gathered;
+                for (const iovec& vector : iov) {
+                    gathered.append((const char*)vector.iov_base, vector.iov_len);
+                }
+                ASSERT_TRUE(gathered == expected);
+                ASSERT_TRUE(string(buffer.c_str(), buffer.size()) == expected);
+            }
+        }
+        ASSERT_GREATER_THAN(buffer.size(), SFastBuffer::CHUNK_SIZE);
+        ASSERT_TRUE(string(buffer.c_str(), buffer.size()) == expected);
+
+        // Consuming everything from a large buffer gives its chunks back to the pool.
+        SFastBuffer large(string(SFastBuffer::CHUNK_SIZE * 8, 'x'));
+        size_t pooledBefore = SFastBuffer::pooledBytes();
+        large.consumeFront(large.size());
+        ASSERT_TRUE(large.empty());
+        ASSERT_TRUE(SFastBuffer::pooledBytes() > pooledBefore);
+    }
+
+    void testIncrementalHTTPParse() {
+        // Two messages, one with content and one chunked, arriving a byte at a time should parse the same way as
+        // they do all at once.
+        const string messages = "first\r\n"
+                                "Content-Length: 5\r\n"
+                                "\r\n"
+                                "hello"
+                                "second\r\n"
+                                "Transfer-Encoding: chunked\r\n"
+                                "\r\n"
+                                "3\r\n"
+                                "abc\r\n"
+                                "2;extension\r\n"
+                                "de\r\n"
+                                "0\r\n"
+                                "footer: value\r\n"
+                                "\r\n";
+        SHTTPParser parser;
+        SFastBuffer buffer;
+        list<SData> parsed;
+        for (char c : messages) {
+            buffer += string(1, c);
+            SData message;
+            int size = message.deserialize(buffer, parser);
+            if (size) {
+                buffer.consumeFront(size);
+                parsed.push_back(message);
+            }
+        }
+        ASSERT_TRUE(buffer.empty());
+        ASSERT_EQUAL(parsed.size(), 2);
+        ASSERT_EQUAL(parsed.front().methodLine, "first");
+        ASSERT_EQUAL(parsed.front().content, "hello");
+        ASSERT_EQUAL(parsed.back().methodLine, "second");
+        ASSERT_EQUAL(parsed.back().content, "abcde");
+        ASSERT_EQUAL(parsed.back()["footer"], "value");
+
+        // If the buffer is replaced with a shorter one, the parser starts over rather than using stale offsets.
+        SData message;
+        buffer.clear();
+        buffer += "partial\r\nContent-Length: 10\r\n\r\nabc";
+        ASSERT_FALSE(message.deserialize(buffer, parser));
+        buffer.clear();
+        buffer += "short\r\n\r\n";
+        ASSERT_EQUAL(message.deserialize(buffer, parser), (int)buffer.size());
+        ASSERT_EQUAL(message.methodLine, "short");
+    }
+
+    void testSlotMap() {
+        SSlotIDs ids;
+        SSlotMap<string> map;
+        uint64_t a = ids.acquire();
+        uint64_t b = ids.acquire();
+        uint64_t c = ids.acquire();
+        map.insert(a, "a");
+        map.insert(b, "b");
+        map.insert(c, "c");
+        ASSERT_EQUAL(map.size(), 3);
+        ASSERT_EQUAL(*map.find(b), "b");
+
+        // Removing from the middle keeps everything else findable.
+        ASSERT_TRUE(map.erase(a));
+        ASSERT_FALSE(map.erase(a));
+        ASSERT_FALSE(map.find(a));
+        ASSERT_EQUAL(*map.find(b), "b");
+        ASSERT_EQUAL(*map.find(c), "c");
+        set<string> values(map.begin(), map.end());
+        ASSERT_EQUAL(values, set<string>({"b", "c"}));
+
+        // A released slot is reused with a new ID, and the old ID doesn't find the new value.
+        ids.release(a);
+        uint64_t d = ids.acquire();
+        ASSERT_EQUAL((uint32_t)d, (uint32_t)a);
+        ASSERT_NOT_EQUAL(d, a);
+        map.insert(d, "d");
+        ASSERT_FALSE(map.find(a));
+        ASSERT_EQUAL(*map.find(d), "d");
+        ASSERT_EQUAL(map.size(), 3);
+    }
+
+    void testMPSCQueue() {
+        // Several threads push in order, and we should get each thread's items back in the order it pushed them, with
+        // a wake up from `poll` whenever there's something to get.
+        SMPSCQueue<unique_ptr<int>> queue;
+        const int threadCount = 4;
+        const int itemsPerThread = 10000;
+        list<thread> producers;
+        for (int t = 0; t < threadCount; t++) {
+            producers.emplace_back([&queue, t]() {
+                for (int i = 0; i < itemsPerThread; i++) {
+                    queue.push(make_unique<int>(t * itemsPerThread + i));
+                }
+            });
+        }
+
+        vector<int> lastSeen(threadCount, -1);
+        int received = 0;
+        bool inOrder = true;
+        while (received < threadCount * itemsPerThread) {
+            fd_map fdm;
+            queue.prePoll(fdm);
+            ASSERT_TRUE(S_poll(fdm, 5 * STIME_US_PER_S) > 0);
+            queue.postPoll(fdm);
+            unique_ptr<int> item;
+            while (queue.pop(item)) {
+                int producer = *item / itemsPerThread;
+                inOrder = inOrder && (*item % itemsPerThread == lastSeen[producer] + 1);
+                lastSeen[producer] = *item % itemsPerThread;
+                received++;
+            }
+        }
+        for (auto& producer : producers) {
+            producer.join();
+        }
+        ASSERT_TRUE(inOrder);
+        unique_ptr<int> item;
+        ASSERT_FALSE(queue.pop(item));
+    }
+
+    void testBinarySData() {
+        // Values that would need escaping in the text format go through untouched.
+        SData request("Query");
+        request["query"] = "SELECT 1;\r\n\r\n";
+        request["empty"] = "";
+        request.content = string("binary\0content", 14);
+        string frame = request.serializeBinary();
+        ASSERT_TRUE(SData::isBinary(frame.c_str(), frame.size()));
+        ASSERT_FALSE(SData::isBinary(request.serialize().c_str(), request.serialize().size()));
+
+        // Nothing is parsed until the whole frame is there.
+        SData result;
+        for (size_t i = 0; i < frame.size(); i++) {
+            ASSERT_EQUAL(result.deserializeBinary(frame.c_str(), i), 0);
+        }
+        string twoFrames = frame + frame;
+        ASSERT_EQUAL(result.deserializeBinary(twoFrames.c_str(), twoFrames.size()), (int)frame.size());
+        ASSERT_EQUAL(result.methodLine, request.methodLine);
+        ASSERT_TRUE(result.nameValueMap == request.nameValueMap);
+        ASSERT_EQUAL(result.content, request.content);
+
+        // The split version produces the same bytes.
+        string headers, body;
+        SData copy = request;
+        copy.serializeBinary(headers, body);
+        ASSERT_EQUAL(headers + body, frame);
+
+        // Integer fields come out as decimal strings.
+        string intFrame;
+        intFrame += (char)SData::BINARY_MAGIC;
+        intFrame += string("\0\0\0\x1F", 4);
+        intFrame += string("\0\0\0\x03", 4) + "Get";
+        intFrame += string("\0\0\0\x01", 4);
+        intFrame += (char)SData::BINARY_INT64;
+        intFrame += string("\0\x05", 2) + "limit";
+        intFrame += string("\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFE", 8);
+        intFrame += string("\0\0\0\0", 4);
+        ASSERT_EQUAL(result.deserializeBinary(intFrame.c_str(), intFrame.size()), (int)intFrame.size());
+        ASSERT_EQUAL(result.methodLine, "Get");
+        ASSERT_EQUAL(result["limit"], "-2");
+
+        // A frame whose contents don't add up to its length is rejected.
+        string badFrame = intFrame;
+        badFrame[4] = '\x20';
+        badFrame += 'x';
+        ASSERT_EQUAL(result.deserializeBinary(badFrame.c_str(), badFrame.size()), -1);
+        badFrame = intFrame;
+        badFrame[13] = '\x07';
+        ASSERT_EQUAL(result.deserializeBinary(badFrame.c_str(), badFrame.size()), -1);
+    }
+
+    void testDNSResolver() {
+        // Raw IPs are answered straight away.
+        auto lookup = SDNSResolver::resolve("127.0.0.1");
+        ASSERT_TRUE(lookup->done());
+        ASSERT_EQUAL(lookup->ip(), inet_addr("127.0.0.1"));
+
+        // Names are looked up in the background, and the lookup can be polled for.
+        SDNSResolver::clearCache();
+        lookup = SDNSResolver::resolve("localhost");
+        ASSERT_EQUAL(lookup->wait(), inet_addr("127.0.0.1"));
+        if (lookup->fd() >= 0) {
+            pollfd ready = {lookup->fd(), POLLIN, 0};
+            ASSERT_EQUAL(poll(&ready, 1, 0), 1);
+        }
+
+        // After which the answer comes from the cache.
+        uint64_t hits = SDNSResolver::cacheHits.load();
+        auto cached = SDNSResolver::resolve("localhost");
+        ASSERT_TRUE(cached->done());
+        ASSERT_EQUAL(cached->ip(), lookup->ip());
+        ASSERT_EQUAL(SDNSResolver::cacheHits.load(), hits + 1);
+
+        // Names that don't resolve aren't cached.
+        ASSERT_EQUAL(SDNSResolver::resolveNow("notarealplaceforsure.invalid"), INADDR_NONE);
+        uint64_t misses = SDNSResolver::cacheMisses.load();
+        ASSERT_EQUAL(SDNSResolver::resolveNow("notarealplaceforsure.invalid"), INADDR_NONE);
+        ASSERT_EQUAL(SDNSResolver::cacheMisses.load(), misses + 1);
+    }
+
+    void testThreadPlacement() {
+        ASSERT_EQUAL(SThreadPlacement::composeCPUList(SThreadPlacement::parseCPUList("0-3,8,5, 6\n")), "0-3,5-6,8");
+        ASSERT_TRUE(SThreadPlacement::parseCPUList("3-1").empty());
+        ASSERT_TRUE(SThreadPlacement::parseCPUList("1,x").empty());
+
+        // Place a thread on one of the CPUs we're allowed to use, by its role, and check it's reported.
+        cpu_set_t mask;
+        ASSERT_EQUAL(sched_getaffinity(0, sizeof(mask), &mask), 0);
+        int cpu = 0;
+        while (!CPU_ISSET(cpu, &mask)) {
+            cpu++;
+        }
+        SThreadPlacement::configure("placed:" + to_string(cpu) + "; bogus");
+        int placedOn = -1;
+        thread([&placedOn]() {
+            SThreadPlacement::apply("placed12");
+            placedOn = sched_getcpu();
+        }).join();
+        SThreadPlacement::configure("");
+        ASSERT_EQUAL(placedOn, cpu);
+        ASSERT_EQUAL(SThreadPlacement::getPlacements()["placed"], to_string(cpu));
+    }
 } __LibStuff;
@@ -0,0 +1,103 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SScheduledPriorityQueue.h>
+#include <BedrockCommandQueue.h>
+#include <libstuff/SShardedPriorityQueue.h>
+#include <test/lib/BedrockTester.h>
+
+// Benchmarks. These take a while and only report timings, so they only run when the tests are run with `-perf`.
+struct PerfTest : tpunit::TestFixture {
+    PerfTest()
+        : tpunit::TestFixture("Perf",
+                              TEST(PerfTest::queueContention),
+                              TEST(PerfTest::commandQueueContention)) { }
+
+    // Many producers and consumers hammering a queue at once. This reports how long the queue took, in `elapsed`, and
+    // checks that every item came out exactly once.
+    template<typename Queue>
+    void runContention(Queue& queue, int producers, int consumers, int itemsPerProducer, uint64_t& elapsed) {
+        atomic<int> consumed(0);
+        atomic<int64_t> sum(0);
+        const int total = producers * itemsPerProducer;
+        uint64_t start = STimeNow();
+        list<thread> threads;
+        for (int i = 0; i < consumers; i++) {
+            threads.emplace_back([&]() {
+                while (consumed.load() < total) {
+                    try {
+                        sum += queue.get(10'000);
+                        consumed++;
+                    } catch (const typename Queue::timeout_error& e) {
+                    }
+                }
+            });
+        }
+        for (int i = 0; i < producers; i++) {
+            threads.emplace_back([&, i]() {
+                for (int j = 0; j < itemsPerProducer; j++) {
+                    queue.push(i * itemsPerProducer + j, j % 5 * 250, 0, STimeNow() + 3600'000'000);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        elapsed = STimeNow() - start;
+        ASSERT_EQUAL(consumed.load(), total);
+        ASSERT_EQUAL(sum.load(), (int64_t)total * (total - 1) / 2);
+        ASSERT_TRUE(queue.empty());
+    }
+
+    void queueContention() {
+        const int producers = 4;
+        const int consumers = max(thread::hardware_concurrency(), 2u);
+        const int itemsPerProducer = 50'000;
+        SScheduledPriorityQueue<int> single;
+        SShardedPriorityQueue<int> sharded(consumers);
+        uint64_t singleUS = 0;
+        uint64_t shardedUS = 0;
+        runContention(single, producers, consumers, itemsPerProducer, singleUS);
+        runContention(sharded, producers, consumers, itemsPerProducer, shardedUS);
+        cout << "[Perf] " << producers * itemsPerProducer << " items, " << producers << " producers, " << consumers
+             << " consumers: SScheduledPriorityQueue " << singleUS / 1000 << "ms, SShardedPriorityQueue "
+             << shardedUS / 1000 << "ms." << endl;
+    }
+
+    // The same, through BedrockCommandQueue, which also records how long each command waited when it's dequeued.
+    void commandQueueContention() {
+        const int producers = 4;
+        const int consumers = max(thread::hardware_concurrency(), 2u);
+        const int commandsPerProducer = 50'000;
+        const int total = producers * commandsPerProducer;
+        BedrockCommandQueue queue(consumers);
+        atomic<int> consumed(0);
+        uint64_t start = STimeNow();
+        list<thread> threads;
+        for (int i = 0; i < consumers; i++) {
+            threads.emplace_back([&]() {
+                while (consumed.load() < total) {
+                    try {
+                        queue.get(10'000);
+                        consumed++;
+                    } catch (const BedrockCommandQueue::timeout_error& e) {
+                    }
+                }
+            });
+        }
+        for (int i = 0; i < producers; i++) {
+            threads.emplace_back([&, i]() {
+                for (int j = 0; j < commandsPerProducer; j++) {
+                    queue.push(make_unique<BedrockCommand>(SQLiteCommand(SData("Command" + to_string(j % 10))), nullptr));
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        uint64_t elapsed = STimeNow() - start;
+        ASSERT_EQUAL(consumed.load(), total);
+        ASSERT_TRUE(queue.empty());
+        cout << "[Perf] " << total << " commands, " << producers << " producers, " << consumers
+             << " consumers: BedrockCommandQueue " << elapsed / 1000 << "ms, standing delay "
+             << queue.standingDelay() << "us." << endl;
+    }
+} __PerfTest;
@@ -0,0 +1,110 @@
+#include <test/lib/BedrockTester.h>
+
+struct PipelineTest : tpunit::TestFixture {
+    PipelineTest()
+        : tpunit::TestFixture("Pipeline",
+                              BEFORE_CLASS(PipelineTest::setup),
+                              TEST(PipelineTest::repliesInOrder),
+                              TEST(PipelineTest::binaryRequests),
+                              AFTER_CLASS(PipelineTest::tearDown)) { }
+
+    BedrockTester* tester;
+
+    void setup() { tester = new BedrockTester(_threadID, {{"-maxPipelinedRequests", "10"}}); }
+
+    void tearDown() { delete tester; }
+
+    void repliesInOrder() {
+        // Send several requests on one connection without waiting for any responses.
+        const int requestCount = 5;
+        SFastBuffer sendBuffer;
+        for (int i = 0; i < requestCount; i++) {
+            SData query("Query");
+            query["query"] = "SELECT " + to_string(i) + ";";
+            sendBuffer += query.serialize();
+        }
+        int socket = S_socket(tester->getServerAddr(), true, false, true);
+        ASSERT_TRUE(socket > 0);
+        while (sendBuffer.size()) {
+            ASSERT_TRUE(S_sendconsume(socket, sendBuffer));
+        }
+
+        // Read responses until we have them all, and verify they came back in the order we sent them.
+        SFastBuffer recvBuffer;
+        list<SData> responses;
+        uint64_t start = STimeNow();
+        while (responses.size() < requestCount && start + 10'000'000 > STimeNow()) {
+            pollfd readSock = {socket, POLLIN, 0};
+            poll(&readSock, 1, 1000);
+            if (readSock.revents & POLLIN) {
+                ASSERT_TRUE(S_recvappend(socket, recvBuffer));
+            }
+            SData response;
+            int size;
+            while ((size = response.deserialize(recvBuffer))) {
+                recvBuffer.consumeFront(size);
+                responses.push_back(response);
+                response.clear();
+            }
+        }
+        ::close(socket);
+
+        ASSERT_EQUAL(responses.size(), requestCount);
+        int i = 0;
+        for (auto& response : responses) {
+            ASSERT_TRUE(SStartsWith(response.methodLine, "200"));
+            ASSERT_EQUAL(SToInt(response.content), i++);
+        }
+    }
+
+    void binaryRequests() {
+        // Binary and text requests can be mixed on one connection, and each gets its response in the same format.
+        SData binaryQuery("Query");
+        binaryQuery["query"] = "SELECT 1;";
+        SData textQuery("Query");
+        textQuery["query"] = "SELECT 2;";
+        SFastBuffer sendBuffer;
+        sendBuffer += binaryQuery.serializeBinary();
+        sendBuffer += textQuery.serialize();
+        sendBuffer += binaryQuery.serializeBinary();
+        int socket = S_socket(tester->getServerAddr(), true, false, true);
+        ASSERT_TRUE(socket > 0);
+        while (sendBuffer.size()) {
+            ASSERT_TRUE(S_sendconsume(socket, sendBuffer));
+        }
+
+        SFastBuffer recvBuffer;
+        list<pair<bool, SData>> responses;
+        uint64_t start = STimeNow();
+        while (responses.size() < 3 && start + 10'000'000 > STimeNow()) {
+            pollfd readSock = {socket, POLLIN, 0};
+            poll(&readSock, 1, 1000);
+            if (readSock.revents & POLLIN) {
+                ASSERT_TRUE(S_recvappend(socket, recvBuffer));
+            }
+            while (recvBuffer.size()) {
+                SData response;
+                bool binary = SData::isBinary(recvBuffer.c_str(), recvBuffer.size());
+                int size = binary ? response.deserializeBinary(recvBuffer.c_str(), recvBuffer.size())
+                                  : response.deserialize(recvBuffer);
+                ASSERT_TRUE(size >= 0);
+                if (!size) {
+                    break;
+                }
+                recvBuffer.consumeFront(size);
+                responses.emplace_back(binary, move(response));
+            }
+        }
+        ::close(socket);
+
+        ASSERT_EQUAL(responses.size(), 3);
+        list<pair<bool, int>> expected = {{true, 1}, {false, 2}, {true, 1}};
+        auto it = expected.begin();
+        for (auto& response : responses) {
+            ASSERT_EQUAL(response.first, it->first);
+            ASSERT_TRUE(SStartsWith(response.second.methodLine, "200"));
+            ASSERT_EQUAL(SToInt(response.second.content), it->second);
+            it++;
+        }
+    }
+} __PipelineTest;
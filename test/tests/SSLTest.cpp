@@ -7,6 +7,8 @@ struct SSLTest : tpunit::TestFixture {
         : tpunit::TestFixture("SSL",
                               BEFORE_CLASS(SSLTest::setup),
                               TEST(SSLTest::test),
+                              TEST(SSLTest::sessionResumption),
+                              TEST(SSLTest::connectionReuse),
                               AFTER_CLASS(SSLTest::teardown))
     { }
 
@@ -42,4 +44,44 @@ struct SSLTest : tpunit::TestFixture {
             ASSERT_TRUE(SStartsWith(results[0].methodLine, url.second));
         }
     }
+
+    void sessionResumption() {
+        // Every connection after the first to the same host should be offered the session from an earlier one.
+        auto getCounts = [this]() {
+            STable status = tester->executeWaitVerifyContentTable(SData("Status"));
+            return make_pair(SToUInt64(status["tlsSessionCacheHits"]), SToUInt64(status["tlsSessionCacheMisses"]));
+        };
+        auto before = getCounts();
+        for (int i = 0; i < 2; i++) {
+            SData request("sendrequest");
+            request["Host"] = "www.google.com";
+            request["Connection"] = "Close";
+            request["httpsConnection"] = "close";
+            request["passthrough"] = "true";
+            vector<SData> results = tester->executeWaitMultipleData({request}, 1);
+            ASSERT_TRUE(SStartsWith(results[0].methodLine, "HTTP/1.1"));
+        }
+        auto after = getCounts();
+        ASSERT_EQUAL(after.first + after.second, before.first + before.second + 2);
+        ASSERT_GREATER_THAN(after.first, before.first);
+    }
+
+    void connectionReuse() {
+        // Requests that leave their connections open should share one, so at most the first needs a TLS handshake (it
+        // may reuse a connection left open by an earlier test).
+        auto getHandshakes = [this]() {
+            STable status = tester->executeWaitVerifyContentTable(SData("Status"));
+            return SToUInt64(status["tlsSessionCacheHits"]) + SToUInt64(status["tlsSessionCacheMisses"]);
+        };
+        uint64_t before = getHandshakes();
+        for (int i = 0; i < 3; i++) {
+            SData request("sendrequest");
+            request["Host"] = "www.google.com";
+            request["Connection"] = "Close";
+            request["passthrough"] = "true";
+            vector<SData> results = tester->executeWaitMultipleData({request}, 1);
+            ASSERT_TRUE(SStartsWith(results[0].methodLine, "HTTP/1.1"));
+        }
+        ASSERT_LESS_THAN(getHandshakes(), before + 2);
+    }
 } __SSLTest;
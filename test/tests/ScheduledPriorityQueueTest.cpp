@@ -0,0 +1,171 @@
+#include <libstuff/libstuff.h>
+#include <libstuff/SScheduledPriorityQueue.h>
+#include <libstuff/SShardedPriorityQueue.h>
+#include <libstuff/STimerWheel.h>
+#include <test/lib/BedrockTester.h>
+
+struct ScheduledPriorityQueueTest : tpunit::TestFixture {
+    ScheduledPriorityQueueTest()
+        : tpunit::TestFixture("ScheduledPriorityQueue",
+                              TEST(ScheduledPriorityQueueTest::ordering),
+                              TEST(ScheduledPriorityQueueTest::erase),
+                              TEST(ScheduledPriorityQueueTest::fairness),
+                              TEST(ScheduledPriorityQueueTest::shardedFairness),
+                              TEST(ScheduledPriorityQueueTest::deadlineOrdering),
+                              TEST(ScheduledPriorityQueueTest::timerWheel),
+                              TEST(ScheduledPriorityQueueTest::scheduledWakeup)) { }
+
+    // Both queues should agree on what comes next.
+    template<typename Queue>
+    void verifyOrdering(Queue& queue) {
+        const uint64_t now = STimeNow();
+        const uint64_t never = now + 3600'000'000;
+        queue.push(1, 0, 0, never);
+        queue.push(2, 1000, 0, never);
+        queue.push(3, 1000, now - 10, never);
+        queue.push(4, 500, 0, never);
+        queue.push(5, 1000, never, never);
+        queue.push(6, 0, never, now - 5);
+        queue.push(7, 1000, 0, never);
+        ASSERT_EQUAL(queue.size(), 7);
+
+        // Timed out first, even if scheduled in the future. Then highest priority, earliest scheduled, and first
+        // pushed. Never anything still scheduled in the future.
+        for (int expected : {6, 2, 7, 3, 4, 1}) {
+            ASSERT_EQUAL(queue.get(), expected);
+        }
+        ASSERT_EQUAL(queue.size(), 1);
+        bool timedOut = false;
+        try {
+            queue.get(1000);
+        } catch (const typename Queue::timeout_error& e) {
+            timedOut = true;
+        }
+        ASSERT_TRUE(timedOut);
+    }
+
+    void ordering() {
+        SScheduledPriorityQueue<int> queue;
+        verifyOrdering(queue);
+        for (size_t shards : {1, 4}) {
+            SShardedPriorityQueue<int> sharded(shards);
+            verifyOrdering(sharded);
+        }
+    }
+
+    void erase() {
+        SShardedPriorityQueue<int> queue(4);
+        const uint64_t now = STimeNow();
+        for (int i = 0; i < 10; i++) {
+            queue.push(move(i), 0, i < 5 ? 0 : now + 1000'000'000, now + 3600'000'000);
+        }
+        ASSERT_EQUAL(queue.eraseScheduledAfter(now + 1000), 5);
+        ASSERT_EQUAL(queue.size(), 5);
+        int sum = 0;
+        queue.forEach([&sum](const int& item) { sum += item; });
+        ASSERT_EQUAL(sum, 0 + 1 + 2 + 3 + 4);
+        queue.clear();
+        ASSERT_TRUE(queue.empty());
+    }
+
+    void fairness() {
+        // One flow floods the queue before two others push anything. They should take turns, with the flood getting
+        // its weight's worth per turn, and the flood still waiting behind higher priority items from anyone.
+        SShardedPriorityQueue<string> queue(1);
+        queue.setFlowWeights({{"flood", 2}});
+        const uint64_t never = STimeNow() + 3600'000'000;
+        for (int i = 0; i < 6; i++) {
+            queue.push("flood", 0, 0, never, "flood");
+        }
+        queue.push("a", 0, 0, never, "a");
+        queue.push("a", 0, 0, never, "a");
+        queue.push("b", 0, 0, never, "b");
+        queue.push("urgent", 1000, 0, never, "flood");
+        list<string> order;
+        while (!queue.empty()) {
+            order.push_back(queue.get());
+        }
+        list<string> expected = {"urgent", "flood", "flood", "a", "b", "flood", "flood", "a", "flood", "flood"};
+        ASSERT_EQUAL(SComposeList(order), SComposeList(expected));
+    }
+
+    void shardedFairness() {
+        // The flood is spread over every shard, ahead of the others in each. The others should still get their turns,
+        // rather than everything the flood pushed going first because it was pushed first.
+        SShardedPriorityQueue<string> queue(4);
+        const uint64_t never = STimeNow() + 3600'000'000;
+        for (int i = 0; i < 40; i++) {
+            queue.push("flood", 0, 0, never, "flood");
+        }
+        for (int i = 0; i < 4; i++) {
+            queue.push("a", 0, 0, never, "a");
+            queue.push("b", 0, 0, never, "b");
+        }
+        map<string, int> counts;
+        for (int i = 0; i < 12; i++) {
+            counts[queue.get()]++;
+        }
+        ASSERT_GREATER_THAN_EQUAL(counts["a"], 3);
+        ASSERT_GREATER_THAN_EQUAL(counts["b"], 3);
+        ASSERT_LESS_THAN(counts["flood"], 7);
+    }
+
+    void deadlineOrdering() {
+        // Within a priority, the item closest to its timeout goes first, whenever it was scheduled or pushed.
+        for (size_t shards : {1, 4}) {
+            SShardedPriorityQueue<int> queue(shards);
+            queue.setDeadlineOrdering(true);
+            const uint64_t now = STimeNow();
+            queue.push(1, 0, 0, now + 3'000'000);
+            queue.push(2, 0, now - 10, now + 1'000'000);
+            queue.push(3, 1000, 0, now + 9'000'000);
+            queue.push(4, 0, 0, now + 2'000'000);
+            for (int expected : {3, 2, 4, 1}) {
+                ASSERT_EQUAL(queue.get(), expected);
+            }
+        }
+    }
+
+    void timerWheel() {
+        // Timers from the past to well past the range of the top level, handed back as time moves forward unevenly.
+        uint64_t now = 1'000'000'000'000;
+        STimerWheel<uint64_t> wheel(now);
+        mt19937_64 random(1);
+        for (int i = 0; i < 10'000; i++) {
+            uint64_t when = now - 1'000'000 + random() % (i % 10 ? 60'000'000 : 40'000'000'000);
+            wheel.insert(when, move(when));
+        }
+        ASSERT_EQUAL(wheel.size(), 10'000);
+        size_t handedBack = 0;
+        bool early = false;
+        while (!wheel.empty()) {
+            ASSERT_TRUE(wheel.nextDue() != UINT64_MAX);
+            now = max(now + random() % 5'000'000, wheel.nextDue());
+            wheel.advance(now, [&](uint64_t when) {
+                early |= when > now;
+                handedBack++;
+            });
+        }
+        ASSERT_FALSE(early);
+        ASSERT_EQUAL(handedBack, 10'000);
+        ASSERT_EQUAL(wheel.nextDue(), UINT64_MAX);
+    }
+
+    void scheduledWakeup() {
+        // A consumer that's already waiting should get a scheduled item when it's due, not when something else wakes
+        // it up, or its wait is over. The bound is loose, so a busy machine doesn't fail this, but still far short of
+        // the wait.
+        SShardedPriorityQueue<int> queue(4);
+        const uint64_t scheduled = STimeNow() + 20'000;
+        thread producer([&]() {
+            usleep(5'000);
+            queue.push(1, 0, scheduled, scheduled + 3600'000'000);
+        });
+        int item = queue.get(10'000'000);
+        const uint64_t received = STimeNow();
+        producer.join();
+        ASSERT_EQUAL(item, 1);
+        ASSERT_GREATER_THAN_EQUAL(received, scheduled);
+        ASSERT_LESS_THAN(received - scheduled, 2'000'000);
+    }
+} __ScheduledPriorityQueueTest;
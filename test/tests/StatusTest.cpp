@@ -18,6 +18,7 @@ struct StatusTest : tpunit::TestFixture {
         string response = tester->executeWaitMultipleData({status})[0].content;
         ASSERT_TRUE(SContains(response, "plugins"));
         ASSERT_TRUE(SContains(response, "multiWriteManualBlacklist"));
+        ASSERT_TRUE(SContains(response, "multiWriteAutoBlacklist"));
     }
 
 } __StatusTest;
@@ -17,6 +17,7 @@ struct WriteTest : tpunit::TestFixture {
                               TEST(WriteTest::failedUpdateNoWhereFalse),
                               TEST(WriteTest::updateAndInsertWithHttp),
                               TEST(WriteTest::shortHandSyntax),
+                              TEST(WriteTest::parameters),
                               AFTER_CLASS(WriteTest::tearDown)) { }
 
     BedrockTester* tester;
@@ -175,4 +176,27 @@ struct WriteTest : tpunit::TestFixture {
         tester->executeWaitVerifyContent(query2);
     }
 
+    void parameters() {
+        BedrockTester::ScopedTransaction transaction(tester);
+        SQLite& db = tester->getSQLiteDB();
+
+        // What gets replicated has the values filled in, quoted the same way `SQ` would.
+        ASSERT_TRUE(db.write("INSERT INTO stuff VALUES (?, ?);", {9001, "it's"}));
+        ASSERT_EQUAL(db.getUncommittedQuery(), "INSERT INTO stuff VALUES (9001, 'it''s');");
+        ASSERT_TRUE(db.write("INSERT INTO stuff VALUES (?, ?);", {9002, nullptr}));
+        ASSERT_EQUAL(db.getUncommittedQuery(),
+                     "INSERT INTO stuff VALUES (9001, 'it''s');INSERT INTO stuff VALUES (9002, NULL);");
+
+        SQResult result;
+        ASSERT_TRUE(db.read("SELECT id, value FROM stuff WHERE id >= ? ORDER BY id;", {9001}, result));
+        ASSERT_EQUAL(result.size(), 2);
+        ASSERT_EQUAL(result[0][1], "it's");
+        ASSERT_EQUAL(result[1][1], "");
+        ASSERT_EQUAL(db.read("SELECT value FROM stuff WHERE id = ?;", {9001}), "it's");
+
+        // The number of values has to match.
+        ASSERT_FALSE(db.read("SELECT value FROM stuff WHERE id = ?;", {9001, 9002}, result));
+        ASSERT_FALSE(db.write("INSERT INTO stuff VALUES (?, ?);", {9003}));
+    }
+
 } __WriteTest;